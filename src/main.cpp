@@ -1,9 +1,110 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <functional>
 #include <iostream>
-#include <vector>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <sstream>
 #include <string>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+// Static tracepoints at tick phase boundaries, e.g. for
+//   bpftrace -e 'usdt:./RouteSimulation:routesim:tick_start { @[arg0] = count(); }'
+// The probes compile to a nop when no tracer is attached, and away entirely
+// where <sys/sdt.h> is not available.
+#if defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define ROUTESIM_PROBE(name, tick) DTRACE_PROBE1(routesim, name, tick)
+#endif
+#endif
+#ifndef ROUTESIM_PROBE
+#define ROUTESIM_PROBE(name, tick) ((void)(tick))
+#endif
+
+// Hardware counters through perf_event_open, Linux only
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/perf_event.h>)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#define ROUTESIM_HAS_PERF_EVENTS 1
+#endif
+#endif
+
+// Runtime-compiled engines are loaded with dlopen where available
+#if defined(__has_include)
+#if __has_include(<dlfcn.h>)
+#include <dlfcn.h>
+#include <sys/stat.h>
+#include <sys/utsname.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#define ROUTESIM_HAS_DLOPEN 1
+#endif
+#endif
+
+// Persistent state is kept in a file mapping where mmap is available
+#if defined(__has_include)
+#if __has_include(<sys/mman.h>) && __has_include(<fcntl.h>)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define ROUTESIM_HAS_MMAP 1
+#endif
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(__AVX__)
+#include <immintrin.h>
+#endif
 
 using Amount = double;
 using Ticks = uint64_t;
+using AssetId = uint32_t;
+
+// Counter-based random numbers: the value for a counter depends only on the
+// seed and the counter (SplitMix64 finalizer), so any tick of any run can
+// be drawn directly without stepping or storing a generator
+inline uint64_t counterHash(uint64_t seed, uint64_t counter)
+{
+    uint64_t z = seed + (counter + 1) * 0x9E3779B97F4A7C15ull;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+// In (0, 1), never 0 so it can be passed to log
+inline double counterUniform(uint64_t seed, uint64_t counter)
+{
+    return (static_cast<double>(counterHash(seed, counter) >> 11) + 0.5) * 0x1p-53;
+}
+
+// Standard normal by Box-Muller from two consecutive counters
+inline double counterNormal(uint64_t seed, uint64_t counter)
+{
+    const double radius = std::sqrt(-2. * std::log(counterUniform(seed, 2 * counter)));
+    return radius * std::cos(6.283185307179586 * counterUniform(seed, 2 * counter + 1));
+}
 
 struct ChainParams
 {
@@ -15,97 +116,66 @@ struct ChainParams
     const Ticks inventoryLockTime;
 };
 
+/// Definition of a chain a simulation starts from
+struct ChainSpec
+{
+    std::string name;
+    ChainParams params;
+    Amount initialOrderflowBal;
+    Amount initialOutflowBal;
+    Amount startingStrategyBal;
+    Amount maxOrderflowBal{ 0. };   // Pool maxima, 0 for 1.5x the initial balance
+    Amount maxOutflowBal{ 0. };
+};
+
+using Scenario = std::vector<ChainSpec>;
+
+/// State of one chain in a simulation. The name and params are not copied,
+/// they point into the scenario data shared by every simulation built from
+/// it, or into the overrides of the simulation. A Chain and its copies must
+/// not outlive those, which is why SimulationState holds on to both.
 struct Chain
 {
-    Chain(
-        std::string&& name,
-        ChainParams&& rp,
-        Amount initialOrderflowBal,
-        Amount initialOutflowBal,
-        Amount startingStrategyBal)
-        : chainName(std::move(name))
-        , currentOrderflowBal(initialOrderflowBal)
-        , currentOutflowBal(initialOutflowBal)
-        , currentStrategyBal(startingStrategyBal)
-        , maxOrderflowBal(currentOrderflowBal * 1.5)
-        , maxOutflowBal(currentOutflowBal * 1.5)
+    Chain(const ChainSpec& spec, const ChainParams& rp)
+        : currentOrderflowBal(spec.initialOrderflowBal)
+        , currentOutflowBal(spec.initialOutflowBal)
+        , currentStrategyBal(spec.startingStrategyBal)
+        , maxOrderflowBal(spec.maxOrderflowBal > 0. ? spec.maxOrderflowBal : currentOrderflowBal * 1.5)
+        , maxOutflowBal(spec.maxOutflowBal > 0. ? spec.maxOutflowBal : currentOutflowBal * 1.5)
         , maxStrategyBal(currentStrategyBal * 1.5)
-        , params(std::move(rp))
-        , balance(startingStrategyBal)
+        , balance(spec.startingStrategyBal)
+        , m_chainName(&spec.name)
+        , m_params(&rp)
     { }
 
-    const std::string chainName;
-    
+    Chain(ChainSpec&&, const ChainParams&) = delete;
+    Chain(const ChainSpec&, ChainParams&&) = delete;
+
+    const std::string& chainName() const { return *m_chainName; }
+    const ChainParams& params() const { return *m_params; }
+
     Amount currentOrderflowBal;
     Amount currentOutflowBal;
     Amount currentStrategyBal;
-    const Amount maxOrderflowBal;
-    const Amount maxOutflowBal;
-    const Amount maxStrategyBal;
-    const ChainParams params;
-    
+    Amount maxOrderflowBal;
+    Amount maxOutflowBal;
+    Amount maxStrategyBal;
+
     Amount balance;
     using LockedAmounts = std::vector<std::pair<Amount, Ticks>>;
     LockedAmounts lockedBalances;
-};
-
-using Chains = std::vector<Chain>;
-
-struct Action
-{
-    enum type
-    {
-        bridge,
-        execute
-    } type;
 
-    std::string source;
-    std::string destination;
-    Amount amount;
+private:
+    const std::string* m_chainName;
+    const ChainParams* m_params;
 };
 
-using Actions = std::vector<Action>;
-
-class IStrategy
-{
-public:
-    virtual ~IStrategy() = default;
-
-    virtual void onTickRecalc(const Chains& chains, Actions& actions) = 0;
-};
+using Chains = std::vector<Chain>;
 
-class Simulation
+inline Scenario defaultScenario()
 {
-public:
-
-    explicit Simulation(IStrategy* strategy)
-        : m_strategy(strategy)
-    {
-        initRoutes();
-    }
-
-    ~Simulation() = default;
-
-    void simulate(uint64_t iterations)
-    {
-        reportState();
-
-        std::cout << "Starting simulation.." << std::endl;
-
-        for (uint64_t t{ 0 }; t < iterations; ++t)
-        {
-            tick(t);
-        }
-
-        std::cout << "..finished." << std::endl;
-
-        reportState();
-    }
-
-private:
-    void initRoutes()
-    {
-        Chain chainA(
+    return Scenario{
+        ChainSpec{
             "A",
             ChainParams{
                 0.64,       // High order flow
@@ -118,9 +188,8 @@ private:
             10,             // Initial order flow balance
             30,             // Initial bridge amount balance
             10              // Starting funds
-        );
-
-        Chain chainB(
+        },
+        ChainSpec{
             "B",
             ChainParams{
                 0.38,       // medium order flow
@@ -133,9 +202,8 @@ private:
             30,             // Initial order flow balance
             10,             // Initial bridge amount balance
             0
-        );
-
-        Chain chainC(
+        },
+        ChainSpec{
             "C",
             ChainParams{
                 0.24,       // Low order flow
@@ -148,217 +216,6618 @@ private:
             40,             // Initial order flow balance
             30,             // Initial bridge amount balance
             0
-        );
+        }
+    };
+}
+
+enum class ParamField
+{
+    orderflowRegenPerTick,
+    outflowRegenPerTick,
+    gasCost,
+    executionSurplus,
+    bridgingTime,
+    inventoryLockTime
+};
 
-        m_chains.push_back(std::move(chainA));
-        m_chains.push_back(std::move(chainB));
-        m_chains.push_back(std::move(chainC));
+inline const char* paramFieldName(ParamField field)
+{
+    switch (field)
+    {
+    case ParamField::orderflowRegenPerTick: return "orderflowRegenPerTick";
+    case ParamField::outflowRegenPerTick: return "outflowRegenPerTick";
+    case ParamField::gasCost: return "gasCost";
+    case ParamField::executionSurplus: return "executionSurplus";
+    case ParamField::bridgingTime: return "bridgingTime";
+    case ParamField::inventoryLockTime: return "inventoryLockTime";
     }
+    return "";
+}
 
-    void tick(uint64_t tickCounter)
+// ChainParams is immutable, overriding a field builds a new one. Tick
+// fields are rounded to the nearest tick.
+inline ChainParams withField(const ChainParams& params, ParamField field, double value)
+{
+    auto ticks = [value]() { return static_cast<Ticks>(std::llround(std::max(value, 0.))); };
+    return ChainParams{
+        field == ParamField::orderflowRegenPerTick ? value : params.orderflowRegenPerTick,
+        field == ParamField::outflowRegenPerTick ? value : params.outflowRegenPerTick,
+        field == ParamField::gasCost ? value : params.gasCost,
+        field == ParamField::executionSurplus ? value : params.executionSurplus,
+        field == ParamField::bridgingTime ? ticks() : params.bridgingTime,
+        field == ParamField::inventoryLockTime ? ticks() : params.inventoryLockTime
+    };
+}
+
+inline void setField(Scenario& scenario, const std::string& chain, ParamField field, double value)
+{
+    Scenario updated;
+    updated.reserve(scenario.size());
+    for (const auto& spec : scenario)
     {
-        if (tickCounter % 100 == 0)
-        {
-            std::cout << "... [" << tickCounter << "] ..." << std::endl;
-        }
+        updated.push_back(ChainSpec{ spec.name, spec.name == chain ? withField(spec.params, field, value) : spec.params,
+            spec.initialOrderflowBal, spec.initialOutflowBal, spec.startingStrategyBal, spec.maxOrderflowBal, spec.maxOutflowBal });
+    }
+    scenario.swap(updated);
+}
 
-        // Tick pending balances and credit to balance if needed
-        for (auto& chain : m_chains)
-        {
-            chain.currentOrderflowBal = std::min(
-                chain.currentOrderflowBal + chain.params.orderflowRegenPerTick,
-                chain.maxOrderflowBal);
+using ChainIndex = std::unordered_map<std::string, size_t>;
 
-            chain.currentOutflowBal = std::min(chain.currentOutflowBal + chain.params.outflowRegenPerTick,
-                chain.maxOutflowBal);
+/// Immutable scenario data shared by all simulations built from it. Chains
+/// reference their names and params here, and name lookups use its index,
+/// so a simulation itself holds only mutable state and any overrides.
+struct ScenarioData
+{
+    Scenario chains;
+    ChainIndex index;
+};
 
-            chain.lockedBalances.erase(
-                std::remove_if(
-                    chain.lockedBalances.begin(),
-                    chain.lockedBalances.end(),
-                    [&chain, &tickCounter](auto& pendingBal) {
-                        auto& [balance, ticks] = pendingBal;
-                        if (ticks > 0) {
-                            --ticks;
-                        }
+using SharedScenario = std::shared_ptr<const ScenarioData>;
 
-                        if (ticks == 0) {
-                            chain.balance += balance;
-                            std::cout << "[" << tickCounter << "]: amount [" << balance << "] now available on "
-                                      << "chain [" << chain.chainName << "]" << std::endl;
-                            // Mark for removal
-                            return true; 
-                        }
-                        return false;
-                    }),
-                chain.lockedBalances.end());
-        }
+inline SharedScenario shareScenario(Scenario scenario)
+{
+    auto data = std::make_shared<ScenarioData>();
+    data->chains = std::move(scenario);
+    for (size_t i{ 0 }; i < data->chains.size(); ++i)
+    {
+        data->index.emplace(data->chains[i].name, i);
+    }
+    return data;
+}
 
-        // Trigger the simualate method
-        Actions actions;
-        m_strategy->onTickRecalc(m_chains, actions);
+inline const SharedScenario& defaultSharedScenario()
+{
+    static const SharedScenario shared = shareScenario(defaultScenario());
+    return shared;
+}
 
-        // Execution strategy actions
-        for (const auto& action : actions)
+/// Per-simulation change of one ChainParams field on top of a shared scenario
+struct ParamOverride
+{
+    size_t chain;
+    ParamField field;
+    double value;
+};
+
+// Builds the chains of a scenario. Params of overridden chains are stored in
+// overridden, which must outlive the chains.
+inline Chains buildChains(const ScenarioData& scenario, const std::vector<ParamOverride>& overrides, std::deque<ChainParams>& overridden)
+{
+    Chains chains;
+    chains.reserve(scenario.chains.size());
+    for (size_t i{ 0 }; i < scenario.chains.size(); ++i)
+    {
+        const ChainParams* params = &scenario.chains[i].params;
+        for (const auto& change : overrides)
         {
-            if (action.source == action.destination)
+            if (change.chain == i)
             {
-                std::cout << "[" << tickCounter << "]: !!! Failed to execute action, chains can't be the same" << std::endl;
-                continue;
+                overridden.push_back(withField(*params, change.field, change.value));
+                params = &overridden.back();
             }
+        }
+        chains.emplace_back(scenario.chains[i], *params);
+    }
+    return chains;
+}
 
-            // get source + destination chains
-            Chain* pSource{ nullptr };
-            Chain* pDestination{ nullptr };
+// Scenario files hold one chain per line: name, the six ChainParams fields
+// in declaration order, the initial order flow, bridging pool and strategy
+// balances and optionally the two pool maxima. '#' starts a comment.
+inline bool saveScenario(const Scenario& scenario, const std::string& path)
+{
+    std::ofstream out(path);
+    out.precision(17);
+    out << "# name orderflowRegenPerTick outflowRegenPerTick gasCost executionSurplus bridgingTime inventoryLockTime "
+        << "initialOrderflowBal initialOutflowBal startingStrategyBal maxOrderflowBal maxOutflowBal\n";
+    for (const auto& spec : scenario)
+    {
+        const ChainParams& p = spec.params;
+        out << spec.name << ' ' << p.orderflowRegenPerTick << ' ' << p.outflowRegenPerTick << ' ' << p.gasCost << ' '
+            << p.executionSurplus << ' ' << p.bridgingTime << ' ' << p.inventoryLockTime << ' '
+            << spec.initialOrderflowBal << ' ' << spec.initialOutflowBal << ' ' << spec.startingStrategyBal << ' '
+            << spec.maxOrderflowBal << ' ' << spec.maxOutflowBal << '\n';
+    }
+    return static_cast<bool>(out);
+}
 
-            for (auto& chain : m_chains)
-            {
-                if (chain.chainName == action.source)
-                {
-                    pSource = &chain;
-                }
-                else if (chain.chainName == action.destination)
-                {
-                    pDestination = &chain;
-                }
-            }
+inline bool loadScenario(const std::string& path, Scenario& scenario)
+{
+    std::ifstream in(path);
+    if (!in)
+    {
+        return false;
+    }
 
-            if (!pSource || !pDestination)
-            {
-                std::cout << "[" << tickCounter << "]: !!! Failed to find chain, skipping action" << std::endl;
-                continue;
-            }
+    Scenario loaded;
+    std::string line;
+    while (std::getline(in, line))
+    {
+        line = line.substr(0, line.find('#'));
+        std::istringstream fields(line);
+        std::string name;
+        if (!(fields >> name))
+        {
+            continue;
+        }
 
-            // check balance
-            if (pSource->balance < action.amount) {
-                std::cout << "[" << tickCounter << "]: !!! Insufficient funds for action, skipping action" << std::endl;
-                continue;
-            }
-            
-            // Execute action if possible
-            if (action.type == Action::type::bridge)
-            {
-                if (pDestination->currentOutflowBal < action.amount) {
-                    std::cout << "[" << tickCounter << "]: !!! Insufficient funds for [bridge] action on destination, skipping action" << std::endl;
-                    continue;
-                }
+        Amount orderflowRegen, outflowRegen, gasCost, executionSurplus;
+        Ticks bridgingTime, inventoryLockTime;
+        Amount orderflowBal, outflowBal, strategyBal;
+        if (!(fields >> orderflowRegen >> outflowRegen >> gasCost >> executionSurplus >> bridgingTime >> inventoryLockTime
+                     >> orderflowBal >> outflowBal >> strategyBal))
+        {
+            return false;
+        }
 
-                if (action.amount < pSource->params.gasCost) {
-                    std::cout << "[" << tickCounter << "]: !!! Insufficient funds to pay for [bridge] action, skipping action" << std::endl;
-                    continue;
-                }
+        Amount maxOrderflowBal{ 0. };
+        Amount maxOutflowBal{ 0. };
+        fields >> maxOrderflowBal >> maxOutflowBal;
+        loaded.push_back(ChainSpec{ name,
+            ChainParams{ orderflowRegen, outflowRegen, gasCost, executionSurplus, bridgingTime, inventoryLockTime },
+            orderflowBal, outflowBal, strategyBal, maxOrderflowBal, maxOutflowBal });
+    }
 
-                const Amount bridgedAmount = action.amount - pSource->params.gasCost;
-                // Destination bridging pool amount reduced
-                pDestination->currentOutflowBal -= action.amount;
-                // Source bridging pool amount increased
-                pSource->currentOutflowBal += action.amount;
-                // Strategy balance reduced
-                pSource->balance -= action.amount;
-                
-                pDestination->lockedBalances.push_back({ bridgedAmount, pSource->params.bridgingTime });
+    scenario.swap(loaded);
+    return true;
+}
 
-                std::cout << "[" << tickCounter << "]: Bridged from [" << pSource->chainName << "] to "
-                          << "[" << pDestination->chainName + "] amount [" << bridgedAmount << "] in "
-                          << "[" << pSource->params.bridgingTime  << "] ticks" << std::endl;
-            }
-            else if (action.type == Action::type::execute)
-            {
-                if (pDestination->currentOrderflowBal < action.amount) {
-                    std::cout << "[" << tickCounter << "]: !!! Insufficient destination funds for [execute] action, skipping action" << std::endl;
-                    continue;
-                }
+struct Action
+{
+    enum type
+    {
+        bridge,
+        execute
+    } type;
 
-                if (action.amount < pSource->params.gasCost) {
-                    std::cout << "[" << tickCounter << "]: !!! Insufficient source funds to pay for [execute] action, skipping action" << std::endl;
-                    continue;
-                }
+    std::string source;
+    std::string destination;
+    Amount amount;
 
-                const Amount amountAfterGasCost = action.amount - pSource->params.gasCost;
-                const Amount creditedAmount = amountAfterGasCost * pSource->params.executionSurplus;
+    // Asset debited on the source chain and credited on the destination chain,
+    // 0 being the chain's native balance
+    AssetId sourceAsset{ 0 };
+    AssetId destinationAsset{ 0 };
+};
 
-                // Reduce source chain order amount
-                pDestination->currentOrderflowBal -= action.amount;
-                
-                // Strategy balance reduced
-                pSource->balance -= action.amount;
+using Actions = std::vector<Action>;
 
-                pDestination->lockedBalances.push_back({ creditedAmount, pSource->params.inventoryLockTime });
+struct AssetParams
+{
+    std::string symbol;
+    Amount rate;        // Value of one unit in native asset terms
+    Amount flowShare;   // Share of each chain's order flow and bridging regen in this asset
+};
 
-                std::cout << "[" << tickCounter << "]: Executed order on [" << pSource->chainName << "] "
-                          << "credited on [" << pDestination->chainName + "] amount [" << creditedAmount << "] "
-                          << "in [" << pSource->params.inventoryLockTime << "] ticks" << std::endl;
-            }
-        }
+/// Dense chain x asset state for the non-native assets. Asset 0 is the native
+/// balance held on Chain, cells for assets 1..n are laid out row-major by chain
+/// in separate arrays so the per-tick kernels stream over contiguous memory.
+/// Pending locks live in a timing wheel of per-cell amounts indexed by the tick
+/// they release on.
+class AssetMatrix
+{
+public:
+    AssetMatrix()
+    {
+        m_assets.push_back(AssetParams{ "native", 1., 1. });
     }
 
-    void reportState()
+    size_t assetCount() const { return m_assets.size(); }
+    size_t chainCount() const { return m_chainCount; }
+    const AssetParams& asset(AssetId id) const { return m_assets[id]; }
+    Amount rate(AssetId id) const { return m_assets[id].rate; }
+
+    // Balances of the extra assets (1..); the native asset 0 is held on Chain.
+    Amount orderflowBal(size_t chain, AssetId asset) const { return m_orderflowBal[cell(chain, asset)]; }
+    Amount outflowBal(size_t chain, AssetId asset) const { return m_outflowBal[cell(chain, asset)]; }
+    Amount balance(size_t chain, AssetId asset) const { return m_balance[cell(chain, asset)]; }
+
+    Amount& orderflowBal(size_t chain, AssetId asset) { return m_orderflowBal[cell(chain, asset)]; }
+    Amount& outflowBal(size_t chain, AssetId asset) { return m_outflowBal[cell(chain, asset)]; }
+    Amount& balance(size_t chain, AssetId asset) { return m_balance[cell(chain, asset)]; }
+
+    AssetId addAsset(AssetParams params, const Chains& chains)
     {
-        // output result of value changes
-        Amount total{ 0. };
+        const size_t oldStride = m_stride;
+        const size_t stride = m_assets.size();
+        const AssetId id = static_cast<AssetId>(m_assets.size());
+        m_assets.push_back(std::move(params));
 
-        for (auto& chain : m_chains)
+        Ticks maxLockTime{ 1 };
+        for (const auto& chain : chains)
         {
-            Amount lockedTotal(0);
-            for (auto& [locked, ticks] : chain.lockedBalances)
+            maxLockTime = std::max({ maxLockTime, chain.params().bridgingTime, chain.params().inventoryLockTime });
+        }
+
+        const size_t chainCount = chains.size();
+        const size_t wheelSize = maxLockTime + 1;
+        std::vector<Amount> orderflowBal(chainCount * stride, 0.);
+        std::vector<Amount> outflowBal(chainCount * stride, 0.);
+        std::vector<Amount> balance(chainCount * stride, 0.);
+        std::vector<Amount> maxOrderflowBal(chainCount * stride, 0.);
+        std::vector<Amount> maxOutflowBal(chainCount * stride, 0.);
+        std::vector<Amount> orderflowRegen(chainCount * stride, 0.);
+        std::vector<Amount> outflowRegen(chainCount * stride, 0.);
+        std::vector<Amount> pending(wheelSize * chainCount * stride, 0.);
+
+        for (size_t c{ 0 }; c < chainCount; ++c)
+        {
+            for (size_t a{ 0 }; a < stride; ++a)
             {
-                lockedTotal += locked;
+                const size_t to = c * stride + a;
+                if (a < oldStride && c < m_chainCount)
+                {
+                    const size_t from = c * oldStride + a;
+                    orderflowBal[to] = m_orderflowBal[from];
+                    outflowBal[to] = m_outflowBal[from];
+                    balance[to] = m_balance[from];
+                    maxOrderflowBal[to] = m_maxOrderflowBal[from];
+                    maxOutflowBal[to] = m_maxOutflowBal[from];
+                    orderflowRegen[to] = m_orderflowRegen[from];
+                    outflowRegen[to] = m_outflowRegen[from];
+                    for (size_t slot{ 0 }; slot < std::min(wheelSize, m_wheelSize); ++slot)
+                    {
+                        pending[slot * chainCount * stride + to] = m_pending[slot * m_chainCount * oldStride + from];
+                    }
+                }
+                else
+                {
+                    const AssetParams& asset = m_assets[a + 1];
+                    orderflowRegen[to] = chains[c].params().orderflowRegenPerTick * asset.flowShare / asset.rate;
+                    outflowRegen[to] = chains[c].params().outflowRegenPerTick * asset.flowShare / asset.rate;
+                }
             }
-            std::cout << "Chain [" << chain.chainName << "] balance [" << chain.balance << "] + locked [" << lockedTotal << "]" << std::endl;
-            total += chain.balance;
-            total += lockedTotal;
         }
 
-        std::cout << "Total : " << total << std::endl;
+        m_chainCount = chainCount;
+        m_stride = stride;
+        m_wheelSize = wheelSize;
+        m_orderflowBal.swap(orderflowBal);
+        m_outflowBal.swap(outflowBal);
+        m_balance.swap(balance);
+        m_maxOrderflowBal.swap(maxOrderflowBal);
+        m_maxOutflowBal.swap(maxOutflowBal);
+        m_orderflowRegen.swap(orderflowRegen);
+        m_outflowRegen.swap(outflowRegen);
+        m_pending.swap(pending);
+        return id;
     }
 
-    IStrategy* m_strategy;
-
-    Chains m_chains;
-};
-
-/// Strategy implementation
+    void setState(size_t chain, AssetId asset, Amount initialOrderflowBal, Amount initialOutflowBal, Amount startingBal)
+    {
+        const size_t i = cell(chain, asset);
+        m_orderflowBal[i] = initialOrderflowBal;
+        m_outflowBal[i] = initialOutflowBal;
+        m_balance[i] = startingBal;
+        m_maxOrderflowBal[i] = initialOrderflowBal * 1.5;
+        m_maxOutflowBal[i] = initialOutflowBal * 1.5;
+    }
 
-class Strategy : public IStrategy
-{
-public:
-    virtual void onTickRecalc(const Chains& chains, Actions& actions) override
+    // Locks follow the Chain::lockedBalances countdown: an amount locked for
+    // ticks on tick t becomes available at the start of tick t + max(ticks, 1)
+    void lock(size_t chain, AssetId asset, Amount amount, Ticks ticks, Ticks now)
     {
-        const Chain* pChainA = getChain(chains, "A");
-        const Chain* pChainB = getChain(chains, "B");
-        const Chain* pChainC = getChain(chains, "C");
+        const size_t slot = (now + std::max<Ticks>(ticks, 1)) % m_wheelSize;
+        m_pending[slot * cellCount() + cell(chain, asset)] += amount;
+    }
 
-        // TODO return actions object with steps in this tick
-        // e.g.1
-        // To bridge 2 from A to B we would perform:
-        
-        if (   pChainA->balance > 2
-            && pChainB->currentOutflowBal > 2)
+    void regenerate(Ticks now)
+    {
+        const size_t n = cellCount();
+        if (n == 0)
         {
-            actions.push_back(Action{ Action::type::bridge, "A", "B", 2 });
+            return;
         }
 
-        // e.g.2
-        // To fill an order of 5 on chain B and being funded on A we would perform:
-        if (   pChainB->balance > 5 
-            && pChainB->currentOrderflowBal > 5 )
+        Amount* orderflowBal = m_orderflowBal.data();
+        Amount* outflowBal = m_outflowBal.data();
+        Amount* balance = m_balance.data();
+        const Amount* maxOrderflowBal = m_maxOrderflowBal.data();
+        const Amount* maxOutflowBal = m_maxOutflowBal.data();
+        const Amount* orderflowRegen = m_orderflowRegen.data();
+        const Amount* outflowRegen = m_outflowRegen.data();
+        Amount* due = m_pending.data() + (now % m_wheelSize) * n;
+
+        for (size_t i{ 0 }; i < n; ++i)
         {
-            actions.push_back(Action{ Action::type::execute, "B", "A", 5 });
+            orderflowBal[i] = std::min(orderflowBal[i] + orderflowRegen[i], maxOrderflowBal[i]);
+        }
+        for (size_t i{ 0 }; i < n; ++i)
+        {
+            outflowBal[i] = std::min(outflowBal[i] + outflowRegen[i], maxOutflowBal[i]);
+        }
+        for (size_t i{ 0 }; i < n; ++i)
+        {
+            balance[i] += due[i];
+            due[i] = 0.;
         }
     }
 
-    const Chain* getChain(const Chains& chains, const std::string& name)
+    Amount balanceTotal(AssetId asset) const
     {
-        auto it = std::find_if(chains.begin(), chains.end(),
-            [&name](const Chain& chain) {
-                return chain.chainName == name;
-            });
+        Amount total{ 0. };
+        for (size_t c{ 0 }; c < m_chainCount; ++c)
+        {
+            total += m_balance[cell(c, asset)];
+        }
+        return total;
+    }
 
-        if (it != chains.end()) {
-            return &(*it);
+    Amount lockedTotal(AssetId asset) const
+    {
+        Amount total{ 0. };
+        for (size_t slot{ 0 }; slot < m_wheelSize; ++slot)
+        {
+            for (size_t c{ 0 }; c < m_chainCount; ++c)
+            {
+                total += m_pending[slot * cellCount() + cell(c, asset)];
+            }
         }
-        return nullptr;
+        return total;
+    }
+
+    // Mutable state as one run of amounts, the pools, balances and pending
+    // wheel in that order, so it can be saved and restored as a whole
+    size_t stateSize() const { return (3 + m_wheelSize) * cellCount(); }
+
+    void saveState(Amount* out) const
+    {
+        out = std::copy(m_orderflowBal.begin(), m_orderflowBal.end(), out);
+        out = std::copy(m_outflowBal.begin(), m_outflowBal.end(), out);
+        out = std::copy(m_balance.begin(), m_balance.end(), out);
+        std::copy(m_pending.begin(), m_pending.end(), out);
     }
+
+    void loadState(const Amount* in)
+    {
+        const size_t n = cellCount();
+        std::copy(in, in + n, m_orderflowBal.begin());
+        std::copy(in + n, in + 2 * n, m_outflowBal.begin());
+        std::copy(in + 2 * n, in + 3 * n, m_balance.begin());
+        std::copy(in + 3 * n, in + 3 * n + m_pending.size(), m_pending.begin());
+    }
+
+private:
+    // Asset 0 lives on Chain itself, only assets 1.. have cells here.
+    size_t cell(size_t chain, AssetId asset) const
+    {
+        assert(asset != 0 && asset <= m_stride && chain < m_chainCount);
+        return chain * m_stride + (asset - 1);
+    }
+    size_t cellCount() const { return m_chainCount * m_stride; }
+
+    std::vector<AssetParams> m_assets;
+    size_t m_chainCount{ 0 };
+    size_t m_stride{ 0 };
+    size_t m_wheelSize{ 1 };
+
+    std::vector<Amount> m_orderflowBal;
+    std::vector<Amount> m_outflowBal;
+    std::vector<Amount> m_balance;
+    std::vector<Amount> m_maxOrderflowBal;
+    std::vector<Amount> m_maxOutflowBal;
+    std::vector<Amount> m_orderflowRegen;
+    std::vector<Amount> m_outflowRegen;
+    std::vector<Amount> m_pending;
+};
+
+enum class BotPhase
+{
+    beforeStrategy,     // Bots fill after regen, the strategy sees what is left
+    alongsideStrategy   // Bots and strategy see the same pools, bots fill first
+};
+
+/// Amounts the bots of a population took from the pools of one simulation
+struct BotFills
+{
+    Amount orderflow{ 0. };
+    Amount outflow{ 0. };
+};
+
+/// Population of simple background fillers competing with the strategy for
+/// order flow and bridging liquidity. Each bot watches one pool on one chain
+/// and, when the pool is above its threshold, asks for a fraction of it up
+/// to a maximum fill. Parameters are held as structure-of-arrays sorted by
+/// (chain, pool) so every chain's pool is a broadcast over a contiguous run
+/// of bots and the demand sum is a straight vectorizable reduction. When the
+/// bots on a pool ask for more than it holds they take all of it; fills are
+/// only tracked per pool, not per bot. Bots are added before the population
+/// is attached, consume() is const so simulations on several threads can
+/// share it, each keeping its own fills.
+class BotPopulation
+{
+public:
+    enum Pool : uint8_t
+    {
+        orderflow,
+        outflow
+    };
+
+    // Inserts the bot at the end of its (chain, pool) run
+    void addBot(size_t chain, Pool pool, Amount threshold, Amount fraction, Amount maxFill)
+    {
+        if (chain >= m_chainCount)
+        {
+            m_offsets.resize((chain + 1) * 2 + 1, m_offsets.back());
+            m_chainCount = chain + 1;
+        }
+
+        const size_t run = chain * 2 + pool;
+        const size_t at = m_offsets[run + 1];
+        m_threshold.insert(m_threshold.begin() + at, threshold);
+        m_fraction.insert(m_fraction.begin() + at, fraction);
+        m_maxFill.insert(m_maxFill.begin() + at, maxFill);
+        for (size_t i{ run + 1 }; i < m_offsets.size(); ++i)
+        {
+            ++m_offsets[i];
+        }
+    }
+
+    // Adds botsPerChain bots of each pool kind to every chain with
+    // parameters drawn uniformly from the given ranges
+    void generate(size_t chainCount, size_t botsPerChain, uint64_t seed,
+        std::pair<Amount, Amount> threshold, std::pair<Amount, Amount> fraction, std::pair<Amount, Amount> maxFill)
+    {
+        std::mt19937_64 rng(seed);
+        auto draw = [&rng](std::pair<Amount, Amount> range) {
+            return std::uniform_real_distribution<Amount>(range.first, range.second)(rng);
+        };
+
+        std::vector<Bot> bots;
+        bots.reserve(chainCount * 2 * botsPerChain);
+        for (size_t c{ 0 }; c < chainCount; ++c)
+        {
+            for (size_t i{ 0 }; i < 2 * botsPerChain; ++i)
+            {
+                bots.push_back(Bot{ c, i % 2 ? outflow : orderflow, draw(threshold), draw(fraction), draw(maxFill) });
+            }
+        }
+        add(bots);
+    }
+
+    size_t size() const { return m_threshold.size(); }
+
+    // Bots on chains beyond the given ones are ignored
+    void consume(Chains& chains, BotFills& fills) const
+    {
+        const size_t chainCount = std::min(m_chainCount, chains.size());
+        const Amount* threshold = m_threshold.data();
+        const Amount* fraction = m_fraction.data();
+        const Amount* maxFill = m_maxFill.data();
+        for (size_t c{ 0 }; c < chainCount; ++c)
+        {
+            for (uint8_t kind : { orderflow, outflow })
+            {
+                Amount& pool = kind == orderflow ? chains[c].currentOrderflowBal : chains[c].currentOutflowBal;
+                const Amount level = pool;
+                const size_t begin = m_offsets[c * 2 + kind];
+                const size_t end = m_offsets[c * 2 + kind + 1];
+
+                // Four independent partial sums so the reduction vectorizes
+                // without relaxing floating point ordering
+                Amount partial[4]{ 0., 0., 0., 0. };
+                size_t i = begin;
+                for (; i + 4 <= end; i += 4)
+                {
+                    for (size_t lane{ 0 }; lane < 4; ++lane)
+                    {
+                        partial[lane] += want(level, threshold[i + lane], fraction[i + lane], maxFill[i + lane]);
+                    }
+                }
+                for (; i < end; ++i)
+                {
+                    partial[0] += want(level, threshold[i], fraction[i], maxFill[i]);
+                }
+                const Amount demand = (partial[0] + partial[1]) + (partial[2] + partial[3]);
+
+                const Amount filled = std::min(demand, level);
+                pool -= filled;
+                (kind == orderflow ? fills.orderflow : fills.outflow) += filled;
+            }
+        }
+    }
+
+private:
+    struct Bot
+    {
+        size_t chain;
+        Pool pool;
+        Amount threshold;
+        Amount fraction;
+        Amount maxFill;
+    };
+
+    // Selects on values rather than std::min's reference so the compiler
+    // can turn both branches into vector blends
+    static Amount want(Amount level, Amount threshold, Amount fraction, Amount maxFill)
+    {
+        const Amount share = level * fraction;
+        const Amount capped = share < maxFill ? share : maxFill;
+        return level > threshold ? capped : 0.;
+    }
+
+    // Merges bots into the arrays in one pass, keeping the order within runs
+    void add(const std::vector<Bot>& added)
+    {
+        std::vector<Bot> bots;
+        for (size_t run{ 0 }; run + 1 < m_offsets.size(); ++run)
+        {
+            for (size_t i{ m_offsets[run] }; i < m_offsets[run + 1]; ++i)
+            {
+                bots.push_back(Bot{ run / 2, static_cast<Pool>(run % 2), m_threshold[i], m_fraction[i], m_maxFill[i] });
+            }
+        }
+        bots.insert(bots.end(), added.begin(), added.end());
+        std::stable_sort(bots.begin(), bots.end(), [](const Bot& a, const Bot& b) {
+            return a.chain != b.chain ? a.chain < b.chain : a.pool < b.pool;
+        });
+
+        for (const auto& bot : bots)
+        {
+            m_chainCount = std::max(m_chainCount, bot.chain + 1);
+        }
+        m_offsets.assign(m_chainCount * 2 + 1, 0);
+        m_threshold.clear();
+        m_fraction.clear();
+        m_maxFill.clear();
+        for (const auto& bot : bots)
+        {
+            ++m_offsets[bot.chain * 2 + bot.pool + 1];
+            m_threshold.push_back(bot.threshold);
+            m_fraction.push_back(bot.fraction);
+            m_maxFill.push_back(bot.maxFill);
+        }
+        for (size_t i{ 1 }; i < m_offsets.size(); ++i)
+        {
+            m_offsets[i] += m_offsets[i - 1];
+        }
+    }
+
+    size_t m_chainCount{ 0 };
+    std::vector<size_t> m_offsets{ 0 };   // First bot of each (chain, pool) run
+    std::vector<Amount> m_threshold;
+    std::vector<Amount> m_fraction;
+    std::vector<Amount> m_maxFill;
+};
+
+struct NettingStats
+{
+    uint64_t actionsIn{ 0 };
+    uint64_t actionsOut{ 0 };
+    Amount gasSaved{ 0. };
+    uint64_t rejected{ 0 };     // Actions combined from several which were then rejected
+};
+
+/// Buffers tick phase spans in memory while the simulation runs and writes
+/// them as Chrome trace-event JSON (chrome://tracing, Perfetto) afterwards.
+/// When disabled now() returns without reading the clock and span() is a
+/// single branch.
+class TraceRecorder
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    void enable(size_t maxEvents)
+    {
+        m_enabled = true;
+        m_maxEvents = maxEvents;
+        m_events.reserve(maxEvents);
+        m_origin = Clock::now();
+    }
+
+    bool enabled() const { return m_enabled; }
+    uint64_t dropped() const { return m_dropped; }
+
+    Clock::time_point now() const
+    {
+        return m_enabled ? Clock::now() : Clock::time_point{};
+    }
+
+    // Records a span from start until now, name and category must be literals
+    void span(const char* name, const char* category, Clock::time_point start, Ticks tick)
+    {
+        if (!m_enabled)
+        {
+            return;
+        }
+
+        if (m_events.size() == m_maxEvents)
+        {
+            ++m_dropped;
+            return;
+        }
+
+        const auto end = Clock::now();
+        m_events.push_back(Event{ name, category, nanoseconds(start - m_origin), nanoseconds(end - start), tick });
+    }
+
+    bool write(const std::string& path) const
+    {
+        std::ofstream out(path);
+        if (!out)
+        {
+            return false;
+        }
+
+        out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+        for (size_t i{ 0 }; i < m_events.size(); ++i)
+        {
+            const Event& event = m_events[i];
+            out << (i ? ",\n" : "\n")
+                << "{\"name\":\"" << event.name << "\",\"cat\":\"" << event.category << "\",\"ph\":\"X\",\"pid\":1,\"tid\":1,"
+                << "\"ts\":" << event.start / 1000 << "." << padded(event.start % 1000) << ","
+                << "\"dur\":" << event.duration / 1000 << "." << padded(event.duration % 1000) << ","
+                << "\"args\":{\"tick\":" << event.tick << "}}";
+        }
+        out << "\n]}\n";
+        return static_cast<bool>(out);
+    }
+
+private:
+    struct Event
+    {
+        const char* name;
+        const char* category;
+        uint64_t start;     // ns since enable()
+        uint64_t duration;  // ns
+        Ticks tick;
+    };
+
+    static uint64_t nanoseconds(Clock::duration d)
+    {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(d).count());
+    }
+
+    // Trace-event timestamps are fractional microseconds
+    static std::string padded(uint64_t ns)
+    {
+        std::string digits = std::to_string(ns);
+        return std::string(3 - digits.size(), '0') + digits;
+    }
+
+    bool m_enabled{ false };
+    size_t m_maxEvents{ 0 };
+    uint64_t m_dropped{ 0 };
+    Clock::time_point m_origin;
+    std::vector<Event> m_events;
+};
+
+enum class CounterPhase
+{
+    regen,
+    bots,
+    strategy,
+    netting,
+    execute,
+    count
+};
+
+/// Hardware performance counters (cycles, instructions, cache misses and
+/// branch misses) read around each tick phase and strategy call, counting
+/// user space of the calling thread only. The counters are opened as one
+/// perf_event_open group so they are read together with a single syscall.
+/// Where the syscall is missing or refused, e.g. by perf_event_paranoid or a
+/// container seccomp profile, enable() returns false and reads are no-ops;
+/// events the CPU does not support are reported as unavailable.
+class PerfCounters
+{
+public:
+    static constexpr size_t eventCount = 4;
+    using Reading = std::array<uint64_t, eventCount>;
+
+    PerfCounters() { m_slot.fill(-1); }
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+    ~PerfCounters() { close(); }
+
+    bool enable()
+    {
+        if (enabled())
+        {
+            return true;
+        }
+
+#ifdef ROUTESIM_HAS_PERF_EVENTS
+        static const uint64_t configs[eventCount] = { PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+            PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES };
+        int opened{ 0 };
+        for (size_t e{ 0 }; e < eventCount; ++e)
+        {
+            perf_event_attr attr{};
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = configs[e];
+            attr.disabled = m_leader < 0 ? 1 : 0;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+            const int fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, m_leader, 0));
+            if (fd < 0)
+            {
+                // Without cycles as the group leader there is nothing to read
+                if (e == 0)
+                {
+                    return false;
+                }
+                continue;
+            }
+
+            if (m_leader < 0)
+            {
+                m_leader = fd;
+            }
+            m_fds[e] = fd;
+            m_slot[e] = opened++;
+        }
+
+        ioctl(m_leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(m_leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    bool enabled() const { return m_leader >= 0; }
+
+    Reading read()
+    {
+        Reading reading{};
+#ifdef ROUTESIM_HAS_PERF_EVENTS
+        if (!enabled())
+        {
+            return reading;
+        }
+
+        // nr, time enabled, time running, then one value per opened event
+        uint64_t buffer[3 + eventCount];
+        if (::read(m_leader, buffer, sizeof(buffer)) < static_cast<ssize_t>(3 * sizeof(uint64_t)))
+        {
+            return reading;
+        }
+        m_multiplexed = m_multiplexed || buffer[2] < buffer[1];
+        for (size_t e{ 0 }; e < eventCount; ++e)
+        {
+            if (m_slot[e] >= 0 && static_cast<uint64_t>(m_slot[e]) < buffer[0])
+            {
+                reading[e] = buffer[3 + m_slot[e]];
+            }
+        }
+#endif
+        return reading;
+    }
+
+    // Adds the counts since start to the phase
+    void add(CounterPhase phase, const Reading& start)
+    {
+        if (!enabled())
+        {
+            return;
+        }
+
+        const Reading end = read();
+        Totals& totals = m_totals[static_cast<size_t>(phase)];
+        for (size_t e{ 0 }; e < eventCount; ++e)
+        {
+            totals.counts[e] += end[e] - start[e];
+        }
+        ++totals.calls;
+    }
+
+    void report(std::ostream& out) const
+    {
+        static const char* phaseNames[] = { "regen", "bots", "strategy", "netting", "execute" };
+        static const char* eventNames[eventCount] = { "cycles", "instructions", "cache misses", "branch misses" };
+
+        for (size_t p{ 0 }; p < static_cast<size_t>(CounterPhase::count); ++p)
+        {
+            const Totals& totals = m_totals[p];
+            if (totals.calls == 0)
+            {
+                continue;
+            }
+
+            out << "Counters [" << phaseNames[p] << "] calls [" << totals.calls << "]";
+            for (size_t e{ 0 }; e < eventCount; ++e)
+            {
+                out << " " << eventNames[e] << " [";
+                if (m_slot[e] < 0)
+                {
+                    out << "n/a]";
+                    continue;
+                }
+                out << static_cast<double>(totals.counts[e]) / totals.calls << "]";
+            }
+            if (m_slot[1] >= 0 && totals.counts[0] > 0)
+            {
+                out << " IPC [" << static_cast<double>(totals.counts[1]) / totals.counts[0] << "]";
+            }
+            out << std::endl;
+        }
+
+        // Counts are then only for the share of time the group was scheduled
+        if (m_multiplexed)
+        {
+            out << "Counters were multiplexed with other events, counts are partial" << std::endl;
+        }
+    }
+
+private:
+    struct Totals
+    {
+        Reading counts{};
+        uint64_t calls{ 0 };
+    };
+
+    void close()
+    {
+#ifdef ROUTESIM_HAS_PERF_EVENTS
+        for (auto& fd : m_fds)
+        {
+            if (fd >= 0)
+            {
+                ::close(fd);
+                fd = -1;
+            }
+        }
+#endif
+        m_leader = -1;
+    }
+
+    int m_leader{ -1 };
+    std::array<int, eventCount> m_fds{ { -1, -1, -1, -1 } };
+    std::array<int, eventCount> m_slot;
+    std::array<Totals, static_cast<size_t>(CounterPhase::count)> m_totals{};
+    bool m_multiplexed{ false };
+};
+
+/// Recorded per-tick order flow and bridging inflows by chain. While attached
+/// to a simulation the recorded inflows replace the ChainParams regen rates
+/// of the matching chains for the ticks the trace covers.
+struct FlowTrace
+{
+    std::vector<std::string> chainNames;
+    Ticks length{ 0 };
+    std::vector<Amount> orderflowRegen;     // [tick * chainNames.size() + chain], NaN where not recorded
+    std::vector<Amount> outflowRegen;
+
+    Amount orderflow(Ticks tick, size_t chain) const { return orderflowRegen[tick * chainNames.size() + chain]; }
+    Amount outflow(Ticks tick, size_t chain) const { return outflowRegen[tick * chainNames.size() + chain]; }
+
+    // Reads "tick,chain,orderflow,outflow" lines, a non-numeric first line is
+    // taken as a header. Fails on any other line which does not hold exactly
+    // those four fields.
+    bool load(const std::string& path)
+    {
+        std::ifstream in(path);
+        if (!in)
+        {
+            return false;
+        }
+
+        struct Row { Ticks tick; size_t chain; Amount orderflow; Amount outflow; };
+        std::vector<Row> rows;
+        std::unordered_map<std::string, size_t> index;
+        chainNames.clear();
+        length = 0;
+
+        std::string line;
+        for (bool first{ true }; std::getline(in, line); first = false)
+        {
+            if (!line.empty() && line.back() == '\r')
+            {
+                line.pop_back();
+            }
+            if (line.empty() || (first && !std::isdigit(static_cast<unsigned char>(line[0]))))
+            {
+                continue;
+            }
+
+            std::replace(line.begin(), line.end(), ',', ' ');
+            std::istringstream fields(line);
+            Row row{};
+            std::string chain;
+            if (!std::isdigit(static_cast<unsigned char>(line[0]))
+                || !(fields >> row.tick >> chain >> row.orderflow >> row.outflow) || !(fields >> std::ws).eof())
+            {
+                return false;
+            }
+
+            auto it = index.emplace(chain, chainNames.size()).first;
+            if (it->second == chainNames.size())
+            {
+                chainNames.push_back(chain);
+            }
+            row.chain = it->second;
+            length = std::max(length, row.tick + 1);
+            rows.push_back(row);
+        }
+
+        const Amount missing = std::numeric_limits<Amount>::quiet_NaN();
+        orderflowRegen.assign(length * chainNames.size(), missing);
+        outflowRegen.assign(length * chainNames.size(), missing);
+        for (const auto& row : rows)
+        {
+            orderflowRegen[row.tick * chainNames.size() + row.chain] = row.orderflow;
+            outflowRegen[row.tick * chainNames.size() + row.chain] = row.outflow;
+        }
+        return true;
+    }
+};
+
+/// Standard deviation of the per-tick regen of a chain's pools, e.g. as
+/// fitted by the Calibrator
+struct FlowNoise
+{
+    Amount orderflowStd{ 0. };
+    Amount outflowStd{ 0. };
+};
+
+/// Low-rank factor structure of flow shocks across chains. The standardized
+/// shock of each pool is
+///   z = sum_k loading_k * f_k + sqrt(1 - sum_k loading_k^2) * e
+/// with factors f_k common to all chains and an idiosyncratic e, all
+/// standard normal, so two pools are correlated by the dot product of their
+/// loadings. FlowNoise still scales each pool's shock. A tick's shocks come
+/// from counters keyed on the seed and tick, for all chains at once, in
+/// passes over blocks of chains: uniforms, then Box-Muller giving both pools
+/// of a chain from one radius and angle, then the factors added one at a
+/// time over contiguous loadings. The arithmetic passes vectorize and a
+/// few factors add little to the cost of the idiosyncratic draws.
+class FlowFactorModel
+{
+public:
+    FlowFactorModel(size_t chains, size_t factors)
+        : m_chains(chains)
+        , m_factors(factors)
+        , m_loadings(2 * factors * chains, 0.)
+        , m_idiosyncratic(2 * chains, 1.)
+    { }
+
+    size_t chains() const { return m_chains; }
+    size_t factors() const { return m_factors; }
+
+    // Returns false, leaving the chain unchanged, unless there is a loading
+    // per factor and each pool's squared loadings sum to at most 1
+    bool setLoadings(size_t chain, const std::vector<double>& orderflow, const std::vector<double>& outflow)
+    {
+        if (chain >= m_chains || orderflow.size() != m_factors || outflow.size() != m_factors)
+        {
+            return false;
+        }
+
+        const std::vector<double>* pools[]{ &orderflow, &outflow };
+        double variances[2]{ 0., 0. };
+        for (size_t pool{ 0 }; pool < 2; ++pool)
+        {
+            for (double loading : *pools[pool])
+            {
+                variances[pool] += loading * loading;
+            }
+        }
+        if (variances[0] > 1. || variances[1] > 1.)
+        {
+            return false;
+        }
+
+        for (size_t pool{ 0 }; pool < 2; ++pool)
+        {
+            for (size_t k{ 0 }; k < m_factors; ++k)
+            {
+                m_loadings[(pool * m_factors + k) * m_chains + chain] = (*pools[pool])[k];
+            }
+            m_idiosyncratic[pool * m_chains + chain] = std::sqrt(1. - variances[pool]);
+        }
+        return true;
+    }
+
+    // Fills orderflow and outflow with one tick's standardized shocks, chains() each
+    void sample(uint64_t seed, uint64_t tick, double* orderflow, double* outflow) const
+    {
+        const uint64_t base = tick * (m_chains + m_factors);
+        double* pools[]{ orderflow, outflow };
+
+        double radius[block];
+        double angle[block];
+        for (size_t first{ 0 }; first < m_chains; first += block)
+        {
+            const size_t count = std::min(block, m_chains - first);
+            for (size_t j{ 0 }; j < count; ++j)
+            {
+                radius[j] = counterUniform(seed, 2 * (base + first + j));
+                angle[j] = counterUniform(seed, 2 * (base + first + j) + 1);
+            }
+            for (size_t j{ 0 }; j < count; ++j)
+            {
+                radius[j] = std::sqrt(-2. * std::log(radius[j]));
+                angle[j] *= 6.283185307179586;
+            }
+            for (size_t j{ 0 }; j < count; ++j)
+            {
+                orderflow[first + j] = m_idiosyncratic[first + j] * radius[j] * std::cos(angle[j]);
+                outflow[first + j] = m_idiosyncratic[m_chains + first + j] * radius[j] * std::sin(angle[j]);
+            }
+
+            // Factors are redrawn per block, which is cheaper than streaming
+            // the shocks through the cache once per factor
+            for (size_t k{ 0 }; k < m_factors; ++k)
+            {
+                const double factor = counterNormal(seed, base + m_chains + k);
+                for (size_t pool{ 0 }; pool < 2; ++pool)
+                {
+                    addScaled(pools[pool] + first, &m_loadings[(pool * m_factors + k) * m_chains + first], factor, count);
+                }
+            }
+        }
+    }
+
+private:
+    static constexpr size_t block{ 256 };
+
+#if defined(__AVX__)
+    using Vec = __m256d;
+    static constexpr size_t lanes = 4;
+    static Vec load(const double* p) { return _mm256_loadu_pd(p); }
+    static void store(double* p, Vec v) { _mm256_storeu_pd(p, v); }
+    static Vec broadcast(double d) { return _mm256_set1_pd(d); }
+    static Vec fma(Vec a, Vec b, Vec c) { return _mm256_add_pd(_mm256_mul_pd(a, b), c); }
+#elif defined(__SSE2__) || defined(_M_X64)
+    using Vec = __m128d;
+    static constexpr size_t lanes = 2;
+    static Vec load(const double* p) { return _mm_loadu_pd(p); }
+    static void store(double* p, Vec v) { _mm_storeu_pd(p, v); }
+    static Vec broadcast(double d) { return _mm_set1_pd(d); }
+    static Vec fma(Vec a, Vec b, Vec c) { return _mm_add_pd(_mm_mul_pd(a, b), c); }
+#else
+    using Vec = double;
+    static constexpr size_t lanes = 1;
+    static Vec load(const double* p) { return *p; }
+    static void store(double* p, Vec v) { *p = v; }
+    static Vec broadcast(double d) { return d; }
+    static Vec fma(Vec a, Vec b, Vec c) { return a * b + c; }
+#endif
+
+    // shocks += loadings * factor, multiply then add so every target rounds the same
+    static void addScaled(double* shocks, const double* loadings, double factor, size_t count)
+    {
+        const Vec f = broadcast(factor);
+        size_t j{ 0 };
+        for (; j + lanes <= count; j += lanes)
+        {
+            store(shocks + j, fma(load(loadings + j), f, load(shocks + j)));
+        }
+        for (; j < count; ++j)
+        {
+            shocks[j] += loadings[j] * factor;
+        }
+    }
+
+    const size_t m_chains;
+    const size_t m_factors;
+    std::vector<double> m_loadings;         // Pool, then factor, then chain
+    std::vector<double> m_idiosyncratic;    // Pool, then chain
+};
+
+/// Mutable state of a simulation at a tick boundary. It keeps the scenario
+/// data and overridden params its chains reference alive, so it may outlive
+/// the simulation it was taken from.
+struct SimulationState
+{
+    Chains chains;
+    AssetMatrix assets;
+    Ticks tick{ 0 };
+    SharedScenario scenario;
+    std::shared_ptr<const std::deque<ChainParams>> overriddenParams;
+};
+
+/// Action with chains resolved to indices, as executed by the simulation
+struct ResolvedAction
+{
+    Amount amount;
+    uint32_t source;
+    uint32_t destination;
+    uint16_t sourceAsset;
+    uint16_t destinationAsset;
+    enum Action::type type;
+};
+
+/// Actions executed on each tick since firstTick, stored flat with the
+/// offset of each tick's first entry
+struct ActionJournal
+{
+    Ticks firstTick{ 0 };
+    std::vector<ResolvedAction> entries;
+    std::vector<uint32_t> tickOffsets;
+
+    void beginTick() { tickOffsets.push_back(static_cast<uint32_t>(entries.size())); }
+
+    Ticks recordedTicks() const { return tickOffsets.size(); }
+
+    const ResolvedAction* begin(Ticks tick) const { return entries.data() + tickOffsets[tick - firstTick]; }
+
+    const ResolvedAction* end(Ticks tick) const
+    {
+        const Ticks next = tick - firstTick + 1;
+        return entries.data() + (next < tickOffsets.size() ? tickOffsets[next] : entries.size());
+    }
+};
+
+enum class ActionOutcome : uint8_t
+{
+    executed,
+    sameChain,
+    unknownChain,
+    unknownAsset,
+    insufficientBalance,
+    insufficientPool,
+    insufficientForGas
+};
+
+inline const char* actionOutcomeName(ActionOutcome outcome)
+{
+    switch (outcome)
+    {
+    case ActionOutcome::executed: return "executed";
+    case ActionOutcome::sameChain: return "sameChain";
+    case ActionOutcome::unknownChain: return "unknownChain";
+    case ActionOutcome::unknownAsset: return "unknownAsset";
+    case ActionOutcome::insufficientBalance: return "insufficientBalance";
+    case ActionOutcome::insufficientPool: return "insufficientPool";
+    case ActionOutcome::insufficientForGas: return "insufficientForGas";
+    }
+    return "";
+}
+
+/// Always-on ring of the last ticks of a run: a summary and the balance and
+/// pool levels of each chain per tick, and the actions with their outcomes.
+/// All storage is allocated up front, so recording is a few stores per tick
+/// and action. Nothing is written to disk until the anomaly predicate fires
+/// on a tick summary, then the ring is dumped as CSV to
+/// <prefix>-<tick>.csv. After a dump the predicate is not checked again
+/// until the ring has been refilled, so one incident gives one file. The
+/// total costs a pass over every chain and asset, so it is only summed for
+/// predicates which use it and is NaN otherwise.
+class FlightRecorder
+{
+public:
+    struct TickSummary
+    {
+        Ticks tick;
+        uint32_t actions;
+        uint32_t rejected;
+        Amount total;
+        Amount previousTotal;
+    };
+
+    // Any callable taking a summary, which is taken to use the total unless
+    // it says otherwise
+    class Predicate
+    {
+    public:
+        Predicate() = default;
+
+        template <typename F, typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, Predicate>
+            && std::is_invocable_r_v<bool, F&, const TickSummary&>>>
+        Predicate(F check, bool usesTotal = true)
+            : m_check(std::move(check))
+            , m_usesTotal(usesTotal)
+        { }
+
+        explicit operator bool() const { return static_cast<bool>(m_check); }
+        bool usesTotal() const { return m_check && m_usesTotal; }
+        bool check(const TickSummary& summary) const { return m_check(summary); }
+
+    private:
+        std::function<bool(const TickSummary&)> m_check;
+        bool m_usesTotal{ false };
+    };
+
+    // Source and destination of actions rejected before chains were resolved
+    static constexpr uint32_t unresolved = UINT32_MAX;
+
+    FlightRecorder(std::string pathPrefix, Predicate anomaly, size_t ticks = 256, size_t actions = 4096, size_t maxDumps = 8)
+        : m_pathPrefix(std::move(pathPrefix))
+        , m_anomaly(std::move(anomaly))
+        , m_ticks(std::max<size_t>(ticks, 1))
+        , m_actions(std::max<size_t>(actions, 1))
+        , m_maxDumps(maxDumps)
+    { }
+
+    static Predicate rejectedAtLeast(uint32_t count)
+    {
+        return Predicate([count](const TickSummary& summary) { return summary.rejected >= count; }, false);
+    }
+
+    // Fires when the total falls by more than fraction of its previous value
+    static Predicate totalDropAbove(double fraction)
+    {
+        return [fraction](const TickSummary& summary) {
+            return summary.previousTotal > 0. && summary.total < summary.previousTotal * (1. - fraction);
+        };
+    }
+
+    void reset(size_t chainCount)
+    {
+        m_chainCount = chainCount;
+        m_summaries.assign(m_ticks, TickSummary{});
+        m_levels.assign(m_ticks * chainCount, Levels{});
+        m_events.assign(m_actions, Event{});
+        m_recordedTicks = 0;
+        m_recordedActions = 0;
+        m_quietUntil = 0;
+        m_hasTotal = false;
+    }
+
+    void recordAction(Ticks tick, const ResolvedAction& action, ActionOutcome outcome)
+    {
+        m_events[m_recordedActions++ % m_actions] = Event{ action, tick, outcome };
+    }
+
+    bool usesTotal() const { return m_anomaly.usesTotal(); }
+
+    // Records the end of a tick and dumps the ring when the predicate fires,
+    // returns the path written or an empty string. The total is only read
+    // when usesTotal().
+    std::string endTick(Ticks tick, uint32_t actions, uint32_t rejected, Amount total, const Chains& chains)
+    {
+        const size_t slot = m_recordedTicks % m_ticks;
+        const TickSummary summary{ tick, actions, rejected, total, m_hasTotal ? m_previousTotal : total };
+        m_summaries[slot] = summary;
+        Levels* levels = &m_levels[slot * m_chainCount];
+        for (size_t c{ 0 }; c < m_chainCount && c < chains.size(); ++c)
+        {
+            levels[c] = Levels{ chains[c].balance, chains[c].currentOrderflowBal, chains[c].currentOutflowBal };
+        }
+        ++m_recordedTicks;
+        m_previousTotal = total;
+        m_hasTotal = true;
+
+        if (m_recordedTicks < m_quietUntil || m_dumps.size() >= m_maxDumps || !m_anomaly || !m_anomaly.check(summary))
+        {
+            return {};
+        }
+
+        const std::string path = m_pathPrefix + "-" + std::to_string(tick) + ".csv";
+        if (!dump(path, chains))
+        {
+            return {};
+        }
+        m_dumps.push_back(path);
+        m_quietUntil = m_recordedTicks + m_ticks;
+        return path;
+    }
+
+    // One record per line, the first column naming the record type
+    bool dump(const std::string& path, const Chains& chains) const
+    {
+        std::ofstream out(path);
+        if (!out)
+        {
+            return false;
+        }
+
+        out.precision(17);
+        const size_t count = std::min(m_recordedTicks, m_ticks);
+        const size_t first = m_recordedTicks - count;
+        out << "tick,tick,actions,rejected,total,totalChange\n";
+        out << "chain,tick,chain,balance,orderflowBal,outflowBal,balanceChange,orderflowChange,outflowChange\n";
+        out << "action,tick,type,source,destination,sourceAsset,destinationAsset,amount,outcome\n";
+        for (size_t i{ first }; i < m_recordedTicks; ++i)
+        {
+            const size_t slot = i % m_ticks;
+            const TickSummary& summary = m_summaries[slot];
+            out << "tick," << summary.tick << "," << summary.actions << "," << summary.rejected << "," << summary.total << ","
+                << summary.total - summary.previousTotal << "\n";
+
+            const Levels* levels = &m_levels[slot * m_chainCount];
+            const Levels* previous = i > first ? &m_levels[((i - 1) % m_ticks) * m_chainCount] : levels;
+            for (size_t c{ 0 }; c < m_chainCount && c < chains.size(); ++c)
+            {
+                out << "chain," << summary.tick << "," << chains[c].chainName() << "," << levels[c].balance << ","
+                    << levels[c].orderflowBal << "," << levels[c].outflowBal << "," << levels[c].balance - previous[c].balance << ","
+                    << levels[c].orderflowBal - previous[c].orderflowBal << "," << levels[c].outflowBal - previous[c].outflowBal << "\n";
+            }
+        }
+
+        // Actions older than the oldest recorded tick have been overwritten
+        // in the tick ring, so they are left out
+        const Ticks oldest = count ? m_summaries[first % m_ticks].tick : 0;
+        const size_t actionCount = std::min(m_recordedActions, m_actions);
+        for (size_t i{ m_recordedActions - actionCount }; i < m_recordedActions; ++i)
+        {
+            const Event& event = m_events[i % m_actions];
+            if (event.tick < oldest)
+            {
+                continue;
+            }
+            out << "action," << event.tick << "," << (event.action.type == Action::type::bridge ? "bridge" : "execute") << ",";
+            writeChain(out, event.action.source, chains);
+            out << ",";
+            writeChain(out, event.action.destination, chains);
+            out << "," << event.action.sourceAsset << "," << event.action.destinationAsset << "," << event.action.amount << ","
+                << actionOutcomeName(event.outcome) << "\n";
+        }
+        return static_cast<bool>(out);
+    }
+
+    const std::vector<std::string>& dumps() const { return m_dumps; }
+
+private:
+    struct Levels
+    {
+        Amount balance{ 0. };
+        Amount orderflowBal{ 0. };
+        Amount outflowBal{ 0. };
+    };
+
+    struct Event
+    {
+        ResolvedAction action{};
+        Ticks tick{ 0 };
+        ActionOutcome outcome{ ActionOutcome::executed };
+    };
+
+    static void writeChain(std::ostream& out, uint32_t chain, const Chains& chains)
+    {
+        if (chain < chains.size())
+        {
+            out << chains[chain].chainName();
+        }
+    }
+
+    const std::string m_pathPrefix;
+    const Predicate m_anomaly;
+    const size_t m_ticks;
+    const size_t m_actions;
+    const size_t m_maxDumps;
+    size_t m_chainCount{ 0 };
+    std::vector<TickSummary> m_summaries;
+    std::vector<Levels> m_levels;
+    std::vector<Event> m_events;
+    size_t m_recordedTicks{ 0 };
+    size_t m_recordedActions{ 0 };
+    size_t m_quietUntil{ 0 };
+    Amount m_previousTotal{ 0. };
+    bool m_hasTotal{ false };
+    std::vector<std::string> m_dumps;
+};
+
+/// Least-squares model of job runtime as a linear function of job features,
+/// e.g. chain count times iterations, fitted from finished jobs and cheap
+/// calibration runs. Predicts 1 for every job until it has samples, so
+/// scheduling on it degrades to plain round robin.
+class RuntimeModel
+{
+public:
+    explicit RuntimeModel(size_t features)
+        : m_dims(features + 1)
+        , m_gram(m_dims * m_dims, 0.)
+        , m_moment(m_dims, 0.)
+    { }
+
+    void record(const std::vector<double>& features, double seconds)
+    {
+        for (size_t i{ 0 }; i < m_dims; ++i)
+        {
+            const double xi = i ? features[i - 1] : 1.;
+            m_moment[i] += xi * seconds;
+            for (size_t j{ 0 }; j < m_dims; ++j)
+            {
+                m_gram[i * m_dims + j] += xi * (j ? features[j - 1] : 1.);
+            }
+        }
+        ++m_samples;
+        m_fitted = false;
+    }
+
+    double predict(const std::vector<double>& features) const
+    {
+        if (m_samples == 0)
+        {
+            return 1.;
+        }
+
+        if (!m_fitted)
+        {
+            fit();
+        }
+        double seconds = m_weights[0];
+        for (size_t i{ 1 }; i < m_dims; ++i)
+        {
+            seconds += m_weights[i] * features[i - 1];
+        }
+        return std::max(seconds, 0.);
+    }
+
+    size_t samples() const { return m_samples; }
+
+private:
+    // Normal equations with a small ridge, solved by Gaussian elimination
+    void fit() const
+    {
+        std::vector<double> a(m_gram);
+        std::vector<double> b(m_moment);
+        double trace{ 0. };
+        for (size_t i{ 0 }; i < m_dims; ++i)
+        {
+            trace += a[i * m_dims + i];
+        }
+        for (size_t i{ 0 }; i < m_dims; ++i)
+        {
+            a[i * m_dims + i] += 1e-9 * trace / m_dims + 1e-12;
+        }
+
+        for (size_t col{ 0 }; col < m_dims; ++col)
+        {
+            size_t pivot = col;
+            for (size_t row{ col + 1 }; row < m_dims; ++row)
+            {
+                if (std::abs(a[row * m_dims + col]) > std::abs(a[pivot * m_dims + col]))
+                {
+                    pivot = row;
+                }
+            }
+            for (size_t k{ 0 }; k < m_dims; ++k)
+            {
+                std::swap(a[col * m_dims + k], a[pivot * m_dims + k]);
+            }
+            std::swap(b[col], b[pivot]);
+
+            for (size_t row{ col + 1 }; row < m_dims; ++row)
+            {
+                const double factor = a[row * m_dims + col] / a[col * m_dims + col];
+                for (size_t k{ col }; k < m_dims; ++k)
+                {
+                    a[row * m_dims + k] -= factor * a[col * m_dims + k];
+                }
+                b[row] -= factor * b[col];
+            }
+        }
+
+        m_weights.assign(m_dims, 0.);
+        for (size_t row = m_dims; row-- > 0;)
+        {
+            double sum = b[row];
+            for (size_t k{ row + 1 }; k < m_dims; ++k)
+            {
+                sum -= a[row * m_dims + k] * m_weights[k];
+            }
+            m_weights[row] = sum / a[row * m_dims + row];
+        }
+        m_fitted = true;
+    }
+
+    const size_t m_dims;
+    std::vector<double> m_gram;
+    std::vector<double> m_moment;
+    size_t m_samples{ 0 };
+    mutable std::vector<double> m_weights;
+    mutable bool m_fitted{ false };
+};
+
+/// Outcome of a run scheduled on runtime estimates. The lower bound is the
+/// best any schedule could do with the measured job times, the larger of
+/// the longest job and the total work spread evenly over the threads.
+struct ScheduleReport
+{
+    std::vector<double> seconds;    // Measured per job
+    double makespan{ 0. };
+    double lowerBound{ 0. };
+    double totalWork{ 0. };
+    size_t steals{ 0 };
+
+    double efficiency() const { return makespan > 0. ? lowerBound / makespan : 1.; }
+};
+
+/// Runs independent jobs over a pool of worker threads started once and
+/// kept for the runner's lifetime, so it is cheap enough to use every tick.
+/// The calling thread takes part and jobs are handed out in index order,
+/// or, given runtime estimates, longest first from per-thread queues with
+/// idle threads stealing the shortest remaining jobs of busy ones.
+/// A run() issued while another is in progress, e.g. from inside a job,
+/// executes serially on the calling thread.
+class BatchRunner
+{
+public:
+    explicit BatchRunner(unsigned threads = std::thread::hardware_concurrency())
+        : m_threads(std::max(1u, threads))
+        , m_queues(m_threads)
+    {
+        for (unsigned t{ 1 }; t < m_threads; ++t)
+        {
+            m_workers.emplace_back([this, t]() { workerLoop(t); });
+        }
+    }
+
+    ~BatchRunner()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_wake.notify_all();
+        for (auto& thread : m_workers)
+        {
+            thread.join();
+        }
+    }
+
+    BatchRunner(const BatchRunner&) = delete;
+    BatchRunner& operator=(const BatchRunner&) = delete;
+
+    unsigned threads() const { return m_threads; }
+
+    template <typename Job>
+    void run(size_t count, Job&& job)
+    {
+        if (m_workers.empty() || count < 2 || m_busy.exchange(true))
+        {
+            for (size_t i{ 0 }; i < count; ++i)
+            {
+                job(i);
+            }
+            return;
+        }
+
+        dispatch(count, job, false);
+    }
+
+    // Jobs are assigned longest-estimate-first to the least loaded thread,
+    // estimates only need to be right relative to each other
+    template <typename Job>
+    ScheduleReport run(size_t count, Job&& job, const std::vector<double>& estimates)
+    {
+        ScheduleReport report;
+        report.seconds.assign(count, 0.);
+        const auto start = std::chrono::steady_clock::now();
+
+        if (m_workers.empty() || count < 2 || m_busy.exchange(true))
+        {
+            for (size_t i{ 0 }; i < count; ++i)
+            {
+                const auto jobStart = std::chrono::steady_clock::now();
+                job(i);
+                report.seconds[i] = secondsSince(jobStart);
+            }
+        }
+        else
+        {
+            std::vector<size_t> order(count);
+            for (size_t i{ 0 }; i < count; ++i)
+            {
+                order[i] = i;
+            }
+            std::stable_sort(order.begin(), order.end(), [&estimates](size_t a, size_t b) {
+                return (a < estimates.size() ? estimates[a] : 0.) > (b < estimates.size() ? estimates[b] : 0.);
+            });
+
+            std::vector<double> load(m_threads, 0.);
+            for (auto& queue : m_queues)
+            {
+                queue.jobs.clear();
+            }
+            for (size_t i : order)
+            {
+                const size_t thread = static_cast<size_t>(std::min_element(load.begin(), load.end()) - load.begin());
+                load[thread] += i < estimates.size() ? estimates[i] : 0.;
+                m_queues[thread].jobs.push_back(i);
+            }
+            m_steals = 0;
+            m_seconds = report.seconds.data();
+
+            dispatch(count, job, true);
+            report.steals = m_steals;
+        }
+
+        report.makespan = secondsSince(start);
+        double longest{ 0. };
+        for (double seconds : report.seconds)
+        {
+            report.totalWork += seconds;
+            longest = std::max(longest, seconds);
+        }
+        report.lowerBound = std::max(longest, report.totalWork / m_threads);
+        return report;
+    }
+
+private:
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<size_t> jobs;
+    };
+
+    static double secondsSince(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    template <typename Job>
+    void dispatch(size_t count, Job& job, bool scheduled)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_call = [](void* context, size_t i) { (*static_cast<std::remove_reference_t<Job>*>(context))(i); };
+            m_context = &job;
+            m_count = count;
+            m_next = 0;
+            m_scheduled = scheduled;
+            m_running = m_workers.size();
+            ++m_generation;
+        }
+        m_wake.notify_all();
+
+        work(0);
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_done.wait(lock, [this]() { return m_running == 0; });
+        m_busy = false;
+    }
+
+    void work(size_t thread)
+    {
+        if (!m_scheduled)
+        {
+            for (size_t i = m_next++; i < m_count; i = m_next++)
+            {
+                m_call(m_context, i);
+            }
+            return;
+        }
+
+        size_t job{ 0 };
+        while (take(thread, job))
+        {
+            const auto start = std::chrono::steady_clock::now();
+            m_call(m_context, job);
+            m_seconds[job] = secondsSince(start);
+        }
+    }
+
+    // Own queue from the front, longest first, otherwise the back of the
+    // next non-empty queue
+    bool take(size_t thread, size_t& job)
+    {
+        {
+            Queue& own = m_queues[thread];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.jobs.empty())
+            {
+                job = own.jobs.front();
+                own.jobs.pop_front();
+                return true;
+            }
+        }
+
+        for (size_t k{ 1 }; k < m_queues.size(); ++k)
+        {
+            Queue& victim = m_queues[(thread + k) % m_queues.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.jobs.empty())
+            {
+                job = victim.jobs.back();
+                victim.jobs.pop_back();
+                ++m_steals;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void workerLoop(size_t thread)
+    {
+        uint64_t seen{ 0 };
+        for (;;)
+        {
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_wake.wait(lock, [&]() { return m_stop || m_generation != seen; });
+                if (m_stop)
+                {
+                    return;
+                }
+                seen = m_generation;
+            }
+
+            work(thread);
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (--m_running == 0)
+            {
+                m_done.notify_one();
+            }
+        }
+    }
+
+    const unsigned m_threads;
+    std::vector<std::thread> m_workers;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+    bool m_stop{ false };
+    uint64_t m_generation{ 0 };
+    size_t m_running{ 0 };
+    std::atomic<bool> m_busy{ false };
+
+    void (*m_call)(void*, size_t){ nullptr };
+    void* m_context{ nullptr };
+    size_t m_count{ 0 };
+    std::atomic<size_t> m_next{ 0 };
+
+    bool m_scheduled{ false };
+    std::vector<Queue> m_queues;
+    double* m_seconds{ nullptr };
+    std::atomic<size_t> m_steals{ 0 };
+};
+
+/// Native pool regeneration and action execution generated as C++ for one
+/// set of chains, with the chain count, params and pool maxima baked in as
+/// constants and the loops unrolled, then compiled into a shared object and
+/// loaded. The kernels work on the chains in place through a table of
+/// pointers to their pools and balance, fieldsPerChain per chain in the
+/// order of Field, lock queues stay with the simulation.
+class SpecializedEngine
+{
+public:
+    using RegenerateFn = void (*)(double* const* fields);
+    using ExecuteFn = int (*)(double* const* fields, int type, uint32_t source, uint32_t destination, double amount,
+        double* credited, uint64_t* lockTicks);
+
+    enum Field
+    {
+        orderflowField,
+        outflowField,
+        balanceField,
+        fieldsPerChain
+    };
+
+    // Fills fields with the table for chains, which must not move while it is used
+    static void fieldsOf(Chains& chains, std::vector<double*>& fields)
+    {
+        fields.resize(chains.size() * fieldsPerChain);
+        for (size_t c{ 0 }; c < chains.size(); ++c)
+        {
+            fields[c * fieldsPerChain + orderflowField] = &chains[c].currentOrderflowBal;
+            fields[c * fieldsPerChain + outflowField] = &chains[c].currentOutflowBal;
+            fields[c * fieldsPerChain + balanceField] = &chains[c].balance;
+        }
+    }
+
+    SpecializedEngine(void* handle, RegenerateFn regenerate, ExecuteFn execute, uint64_t hash)
+        : m_handle(handle)
+        , m_regenerate(regenerate)
+        , m_execute(execute)
+        , m_hash(hash)
+    { }
+
+    SpecializedEngine(const SpecializedEngine&) = delete;
+    SpecializedEngine& operator=(const SpecializedEngine&) = delete;
+
+    ~SpecializedEngine()
+    {
+#ifdef ROUTESIM_HAS_DLOPEN
+        dlclose(m_handle);
+#endif
+    }
+
+    void regenerate(double* const* fields) const { m_regenerate(fields); }
+
+    // Executes a native action, filling in the amount and ticks to lock on
+    // the destination when it succeeds
+    ActionOutcome execute(double* const* fields, const ResolvedAction& action, Amount& credited, Ticks& lockTicks) const
+    {
+        uint64_t ticks{ 0 };
+        const int outcome = m_execute(fields, static_cast<int>(action.type), action.source,
+            action.destination, action.amount, &credited, &ticks);
+        lockTicks = ticks;
+        return static_cast<ActionOutcome>(outcome);
+    }
+
+    uint64_t hash() const { return m_hash; }
+
+    static std::string generateSource(const Chains& chains)
+    {
+        std::ostringstream out;
+        out << std::hexfloat;
+        out << "// Generated for " << chains.size() << " chains\n"
+            << "#include <cstdint>\n"
+            << "static const unsigned long stride = " << fieldsPerChain << ";\n"
+            << "static const unsigned long orderflowAt = " << orderflowField << ";\n"
+            << "static const unsigned long outflowAt = " << outflowField << ";\n"
+            << "static const unsigned long balanceAt = " << balanceField << ";\n"
+            << "static inline double& field(double* const* fields, unsigned long chain, unsigned long at)\n"
+            << "{ return *fields[chain * stride + at]; }\n\n";
+
+        // Same operations in the same order as Simulation::regenerate, so
+        // results match the generic engine exactly
+        out << "extern \"C\" void routesim_regenerate(double* const* chains)\n{\n";
+        for (size_t c{ 0 }; c < chains.size(); ++c)
+        {
+            const Chain& chain = chains[c];
+            out << "    { double& v = field(chains, " << c << ", orderflowAt); const double r = v + " << chain.params().orderflowRegenPerTick
+                << "; v = " << chain.maxOrderflowBal << " < r ? " << chain.maxOrderflowBal << " : r; }\n"
+                << "    { double& v = field(chains, " << c << ", outflowAt); const double r = v + " << chain.params().outflowRegenPerTick
+                << "; v = " << chain.maxOutflowBal << " < r ? " << chain.maxOutflowBal << " : r; }\n";
+        }
+        out << "}\n\n";
+
+        // One function per source chain, as in Simulation::executeResolved
+        for (size_t c{ 0 }; c < chains.size(); ++c)
+        {
+            const ChainParams& params = chains[c].params();
+            out << "static int execute" << c << "(double* const* chains, int type, uint32_t destination, double amount, double* credited, "
+                << "uint64_t* lockTicks)\n{\n"
+                << "    double& sourceBal = field(chains, " << c << ", balanceAt);\n"
+                << "    if (sourceBal < amount) return " << outcomeCode(ActionOutcome::insufficientBalance) << ";\n"
+                << "    if (type == " << static_cast<int>(Action::type::bridge) << ")\n    {\n"
+                << "        double& pool = field(chains, destination, outflowAt);\n"
+                << "        if (pool < amount) return " << outcomeCode(ActionOutcome::insufficientPool) << ";\n"
+                << "        if (amount < " << params.gasCost << ") return " << outcomeCode(ActionOutcome::insufficientForGas) << ";\n"
+                << "        *credited = amount - " << params.gasCost << ";\n"
+                << "        pool -= amount;\n"
+                << "        field(chains, " << c << ", outflowAt) += amount;\n"
+                << "        sourceBal -= amount;\n"
+                << "        *lockTicks = " << params.bridgingTime << "u;\n"
+                << "    }\n"
+                << "    else if (type == " << static_cast<int>(Action::type::execute) << ")\n    {\n"
+                << "        double& pool = field(chains, destination, orderflowAt);\n"
+                << "        if (pool < amount) return " << outcomeCode(ActionOutcome::insufficientPool) << ";\n"
+                << "        if (amount < " << params.gasCost << ") return " << outcomeCode(ActionOutcome::insufficientForGas) << ";\n"
+                << "        *credited = (amount - " << params.gasCost << ") * " << params.executionSurplus << ";\n"
+                << "        pool -= amount;\n"
+                << "        sourceBal -= amount;\n"
+                << "        *lockTicks = " << params.inventoryLockTime << "u;\n"
+                << "    }\n"
+                << "    return " << outcomeCode(ActionOutcome::executed) << ";\n}\n\n";
+        }
+
+        out << "extern \"C\" int routesim_execute(double* const* chains, int type, uint32_t source, uint32_t destination, double amount, "
+            << "double* credited, uint64_t* lockTicks)\n{\n    switch (source)\n    {\n";
+        for (size_t c{ 0 }; c < chains.size(); ++c)
+        {
+            out << "    case " << c << ": return execute" << c << "(chains, type, destination, amount, credited, lockTicks);\n";
+        }
+        out << "    }\n    return " << outcomeCode(ActionOutcome::unknownChain) << ";\n}\n";
+        return out.str();
+    }
+
+    // FNV-1a, the source encodes everything the engine depends on
+    static uint64_t hashSource(const std::string& source)
+    {
+        uint64_t hash{ 14695981039346656037ull };
+        for (unsigned char c : source)
+        {
+            hash = (hash ^ c) * 1099511628211ull;
+        }
+        return hash;
+    }
+
+private:
+    static int outcomeCode(ActionOutcome outcome) { return static_cast<int>(outcome); }
+
+    void* m_handle;
+    RegenerateFn m_regenerate;
+    ExecuteFn m_execute;
+    uint64_t m_hash;
+};
+
+/// Builds specialized engines and caches them by a hash of the generated
+/// source, the compiler, its flags and the host, both loaded in this process
+/// and as shared objects in a cache directory reused across runs. The
+/// default directory is private to the user, under $XDG_CACHE_HOME or
+/// ~/.cache; it is created 0700 and refused when another user owns it or can
+/// write to it. The compiler is taken from $ROUTESIM_CXX, else c++, and run
+/// directly rather than through a shell. get() returns nullptr when
+/// compiling or loading fails, e.g. on platforms without dlopen or with no
+/// compiler installed.
+class EngineCache
+{
+public:
+    explicit EngineCache(std::string directory = defaultDirectory())
+        : m_directory(std::move(directory))
+    {
+        const char* compiler = std::getenv("ROUTESIM_CXX");
+        m_compiler = compiler && *compiler ? compiler : "c++";
+
+        // -march=native ties a library to the host, so it is part of the key
+        m_signature = m_compiler;
+        for (const char* flag : flags)
+        {
+            m_signature += std::string(" ") + flag;
+        }
+        m_signature += "\n" + hostTarget() + "\n";
+    }
+
+    std::shared_ptr<const SpecializedEngine> get(const Chains& chains)
+    {
+        if (chains.empty())
+        {
+            return nullptr;
+        }
+
+        const std::string source = SpecializedEngine::generateSource(chains);
+        const uint64_t hash = SpecializedEngine::hashSource(m_signature + source);
+
+        // Held while compiling so jobs of one sweep build each engine once
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_loaded.find(hash);
+        if (it != m_loaded.end())
+        {
+            return it->second;
+        }
+
+        auto engine = build(source, hash);
+        if (engine)
+        {
+            m_loaded.emplace(hash, engine);
+        }
+        return engine;
+    }
+
+    size_t compiled() const { return m_compiled; }
+
+    static std::string defaultDirectory()
+    {
+        const char* cache = std::getenv("XDG_CACHE_HOME");
+        if (cache && *cache == '/')
+        {
+            return std::string(cache) + "/routesim-engines";
+        }
+        const char* home = std::getenv("HOME");
+        if (home && *home == '/')
+        {
+            return std::string(home) + "/.cache/routesim-engines";
+        }
+#ifdef ROUTESIM_HAS_DLOPEN
+        return "/tmp/routesim-engines-" + std::to_string(::getuid());
+#else
+        return "routesim-engines";
+#endif
+    }
+
+private:
+    static constexpr const char* flags[]{ "-std=c++17", "-O3", "-march=native", "-shared", "-fPIC" };
+
+    static std::string hostTarget()
+    {
+#ifdef ROUTESIM_HAS_DLOPEN
+        struct utsname host{};
+        if (::uname(&host) == 0)
+        {
+            return std::string(host.sysname) + " " + host.machine + " " + host.nodename;
+        }
+#endif
+        return "unknown";
+    }
+
+#ifdef ROUTESIM_HAS_DLOPEN
+    // Creates the missing parts of the path, the last one private to the user
+    static bool privateDirectory(const std::string& path)
+    {
+        for (size_t at = path.find('/', 1); ; at = path.find('/', at + 1))
+        {
+            const std::string part = path.substr(0, at);
+            if (::mkdir(part.c_str(), 0700) != 0 && errno != EEXIST)
+            {
+                return false;
+            }
+            if (at == std::string::npos)
+            {
+                break;
+            }
+        }
+
+        struct stat status{};
+        return ::lstat(path.c_str(), &status) == 0 && S_ISDIR(status.st_mode) && status.st_uid == ::getuid()
+            && (status.st_mode & (S_IWGRP | S_IWOTH)) == 0;
+    }
+
+    // Runs the compiler without a shell, so no path or variable is interpreted
+    bool compile(const std::string& source, const std::string& library) const
+    {
+        std::vector<std::string> args{ m_compiler };
+        args.insert(args.end(), std::begin(flags), std::end(flags));
+        args.insert(args.end(), { "-o", library, source });
+        std::vector<char*> argv;
+        for (auto& arg : args)
+        {
+            argv.push_back(&arg[0]);
+        }
+        argv.push_back(nullptr);
+
+        const pid_t pid = ::fork();
+        if (pid < 0)
+        {
+            return false;
+        }
+        if (pid == 0)
+        {
+            ::execvp(argv[0], argv.data());
+            ::_exit(127);
+        }
+
+        int status{ 0 };
+        while (::waitpid(pid, &status, 0) < 0)
+        {
+            if (errno != EINTR)
+            {
+                return false;
+            }
+        }
+        return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    }
+#endif
+
+    std::shared_ptr<const SpecializedEngine> build(const std::string& source, uint64_t hash)
+    {
+#ifdef ROUTESIM_HAS_DLOPEN
+        std::ostringstream name;
+        name << m_directory << "/engine-" << std::hex << hash;
+        const std::string library = name.str() + ".so";
+
+        if (!privateDirectory(m_directory))
+        {
+            return nullptr;
+        }
+
+        if (!std::ifstream(library))
+        {
+            // Built under a unique name and renamed into place, so concurrent
+            // processes never load a partly written library
+            const std::string unique = name.str() + "-" + std::to_string(::getpid()) + "-"
+                + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count());
+            {
+                std::ofstream out(unique + ".cpp");
+                if (!(out << source))
+                {
+                    return nullptr;
+                }
+            }
+
+            const bool built = compile(unique + ".cpp", unique + ".so");
+            std::remove((unique + ".cpp").c_str());
+            if (!built || std::rename((unique + ".so").c_str(), library.c_str()) != 0)
+            {
+                std::remove((unique + ".so").c_str());
+                return nullptr;
+            }
+            ++m_compiled;
+        }
+
+        void* handle = dlopen(library.c_str(), RTLD_NOW | RTLD_LOCAL);
+        if (!handle)
+        {
+            return nullptr;
+        }
+
+        auto regenerate = reinterpret_cast<SpecializedEngine::RegenerateFn>(dlsym(handle, "routesim_regenerate"));
+        auto execute = reinterpret_cast<SpecializedEngine::ExecuteFn>(dlsym(handle, "routesim_execute"));
+        if (!regenerate || !execute)
+        {
+            dlclose(handle);
+            return nullptr;
+        }
+        return std::make_shared<const SpecializedEngine>(handle, regenerate, execute, hash);
+#else
+        (void)source;
+        (void)hash;
+        return nullptr;
+#endif
+    }
+
+    const std::string m_directory;
+    std::string m_compiler;
+    std::string m_signature;
+    std::mutex m_mutex;
+    std::unordered_map<uint64_t, std::shared_ptr<const SpecializedEngine>> m_loaded;
+    size_t m_compiled{ 0 };
+};
+
+/// Mutable chain and asset state kept in a shared file mapping and
+/// committed every commitInterval ticks, so a run killed at any point
+/// resumes from its last committed tick by copying the mapped arrays back.
+/// There are two slots, each with a commit record: a slot's record is
+/// invalidated before the slot is overwritten and validated last, with a
+/// checksum of the slot's contents, and recovery takes the newest valid one.
+/// Writes reach the file through the page cache, which outlives the
+/// process; msync every syncInterval commits bounds what an operating
+/// system crash can lose.
+class PersistentState
+{
+public:
+    explicit PersistentState(Ticks syncInterval = 0, Ticks commitInterval = 1)
+        : m_syncInterval(syncInterval)
+        , m_commitInterval(std::max<Ticks>(commitInterval, 1))
+    { }
+
+    ~PersistentState() { close(); }
+
+    PersistentState(const PersistentState&) = delete;
+    PersistentState& operator=(const PersistentState&) = delete;
+
+    // Maps path for the chains and the extra assets' state. A file holding
+    // state of the same scenario is kept along with its lock capacity,
+    // anything else is cleared. The lock capacity is the pending locks a slot
+    // holds in total, 0 for 64 per chain.
+    bool open(const std::string& path, const Chains& chains, const AssetMatrix& assets, size_t lockCapacity = 0)
+    {
+        close();
+#ifdef ROUTESIM_HAS_MMAP
+        const uint64_t scenario = hashState(chains, assets);
+        m_fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (m_fd < 0)
+        {
+            return false;
+        }
+
+        Header header{};
+        const bool reuse = ::pread(m_fd, &header, sizeof(header), 0) == static_cast<ssize_t>(sizeof(header))
+            && header.magic == magic && header.version == version
+            && header.scenario == scenario && header.chains == chains.size() && header.assetAmounts == assets.stateSize();
+        if (!reuse)
+        {
+            header = Header{ magic, version, scenario, chains.size(), lockCapacity > 0 ? lockCapacity : 64 * chains.size(), assets.stateSize() };
+        }
+
+        m_chains = header.chains;
+        m_lockCapacity = header.lockCapacity;
+        m_assetAmounts = header.assetAmounts;
+        m_slotBytes = (usedBytes(0) + m_lockCapacity * sizeof(LockRecord) + 63) / 64 * 64;
+        m_bytes = slotOffset + 2 * m_slotBytes;
+
+        struct stat status{};
+        if ((!reuse && ::ftruncate(m_fd, 0) != 0)
+            || ::fstat(m_fd, &status) != 0
+            || (static_cast<size_t>(status.st_size) < m_bytes && ::ftruncate(m_fd, static_cast<off_t>(m_bytes)) != 0))
+        {
+            close();
+            return false;
+        }
+
+        void* base = ::mmap(nullptr, m_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+        if (base == MAP_FAILED)
+        {
+            close();
+            return false;
+        }
+        m_base = static_cast<char*>(base);
+        if (!reuse)
+        {
+            std::memcpy(m_base, &header, sizeof(header));
+        }
+
+        const int newest = newestRecord();
+        m_sequence = newest < 0 ? 1 : records()[newest].sequence + 1;
+        return true;
+#else
+        (void)path;
+        (void)chains;
+        (void)assets;
+        (void)lockCapacity;
+        return false;
+#endif
+    }
+
+    // Simulations without extra assets
+    bool open(const std::string& path, const Chains& chains, size_t lockCapacity = 0)
+    {
+        return open(path, chains, AssetMatrix(), lockCapacity);
+    }
+
+    bool isOpen() const { return m_base != nullptr; }
+
+    // Whether the mapping was laid out for state of this shape
+    bool fits(const Chains& chains, const AssetMatrix& assets) const
+    {
+        return isOpen() && chains.size() == m_chains && assets.stateSize() == m_assetAmounts;
+    }
+
+    // Whether the file holds a committed tick to resume from
+    bool recoverable() const { return isOpen() && newestRecord() >= 0; }
+
+    Ticks committedTick() const { return recoverable() ? records()[newestRecord()].tick : 0; }
+
+    // Commits the state reached at tick when tick is a multiple of the
+    // commit interval. Returns false, keeping the previous commit, when the
+    // state does not fit the mapping or the pending locks exceed the capacity.
+    bool commit(const Chains& chains, const AssetMatrix& assets, Ticks tick)
+    {
+        if (!fits(chains, assets))
+        {
+            return false;
+        }
+        if (tick % m_commitInterval != 0)
+        {
+            return true;
+        }
+
+        size_t locks{ 0 };
+        for (const auto& chain : chains)
+        {
+            locks += chain.lockedBalances.size();
+        }
+        if (locks > m_lockCapacity)
+        {
+            return false;
+        }
+
+        CommitRecord& record = records()[m_sequence % 2];
+        char* slot = slotAt(m_sequence % 2);
+        record.check = 0;
+        std::atomic_thread_fence(std::memory_order_release);
+
+        ChainRecord* chainRecords = reinterpret_cast<ChainRecord*>(slot);
+        LockRecord* lockRecords = reinterpret_cast<LockRecord*>(slot + usedBytes(0));
+        assets.saveState(reinterpret_cast<Amount*>(slot + m_chains * sizeof(ChainRecord)));
+        for (const auto& chain : chains)
+        {
+            *chainRecords++ = ChainRecord{ chain.currentOrderflowBal, chain.currentOutflowBal, chain.currentStrategyBal,
+                chain.balance, chain.lockedBalances.size() };
+            for (const auto& [amount, ticks] : chain.lockedBalances)
+            {
+                *lockRecords++ = LockRecord{ amount, ticks };
+            }
+        }
+        std::atomic_thread_fence(std::memory_order_release);
+
+        record.sequence = m_sequence;
+        record.tick = tick;
+        record.locks = locks;
+        std::atomic_thread_fence(std::memory_order_release);
+        record.check = checkOf(record, checksumOf(slot, usedBytes(locks)));
+        ++m_sequence;
+
+        if (m_syncInterval > 0 && ++m_sinceSync >= m_syncInterval)
+        {
+            sync();
+        }
+        return true;
+    }
+
+    // Copies the newest committed state into chains and assets of the same
+    // scenario
+    bool recover(Chains& chains, AssetMatrix& assets, Ticks& tick) const
+    {
+        const int newest = fits(chains, assets) ? newestRecord() : -1;
+        if (newest < 0)
+        {
+            return false;
+        }
+
+        const char* slot = slotAt(newest);
+        const ChainRecord* chainRecords = reinterpret_cast<const ChainRecord*>(slot);
+        const LockRecord* lockRecords = reinterpret_cast<const LockRecord*>(slot + usedBytes(0));
+        assets.loadState(reinterpret_cast<const Amount*>(slot + m_chains * sizeof(ChainRecord)));
+        for (auto& chain : chains)
+        {
+            const ChainRecord& record = *chainRecords++;
+            chain.currentOrderflowBal = record.orderflowBal;
+            chain.currentOutflowBal = record.outflowBal;
+            chain.currentStrategyBal = record.strategyBal;
+            chain.balance = record.balance;
+            chain.lockedBalances.clear();
+            for (uint64_t k{ 0 }; k < record.locks; ++k, ++lockRecords)
+            {
+                chain.lockedBalances.push_back({ lockRecords->amount, lockRecords->ticks });
+            }
+        }
+        tick = records()[newest].tick;
+        return true;
+    }
+
+    void sync()
+    {
+#ifdef ROUTESIM_HAS_MMAP
+        if (isOpen())
+        {
+            ::msync(m_base, m_bytes, MS_SYNC);
+        }
+#endif
+        m_sinceSync = 0;
+    }
+
+    void close()
+    {
+#ifdef ROUTESIM_HAS_MMAP
+        if (m_base)
+        {
+            ::munmap(m_base, m_bytes);
+        }
+        if (m_fd >= 0)
+        {
+            ::close(m_fd);
+        }
+#endif
+        m_base = nullptr;
+        m_fd = -1;
+    }
+
+private:
+    static constexpr uint64_t magic{ 0x544154534D495352ull };   // "RSIMSTAT" little endian
+    static constexpr uint64_t version{ 2 };
+    static constexpr size_t slotOffset{ 128 };                  // Header, then the two commit records
+
+    struct Header
+    {
+        uint64_t magic;
+        uint64_t version;
+        uint64_t scenario;
+        uint64_t chains;
+        uint64_t lockCapacity;
+        uint64_t assetAmounts;
+    };
+
+    struct CommitRecord
+    {
+        uint64_t sequence;
+        uint64_t tick;
+        uint64_t locks;
+        uint64_t check;     // Written last, 0 while the slot is being written
+    };
+
+    struct ChainRecord
+    {
+        Amount orderflowBal;
+        Amount outflowBal;
+        Amount strategyBal;
+        Amount balance;
+        uint64_t locks;
+    };
+
+    struct LockRecord
+    {
+        Amount amount;
+        Ticks ticks;
+    };
+
+    // Names, params, pool maxima and assets, everything the mutable state is
+    // relative to
+    static uint64_t hashState(const Chains& chains, const AssetMatrix& assets)
+    {
+        uint64_t hash = counterHash(magic, chains.size());
+        for (AssetId id{ 1 }; id < assets.assetCount(); ++id)
+        {
+            for (unsigned char c : assets.asset(id).symbol)
+            {
+                hash = (hash ^ c) * 1099511628211ull;
+            }
+            uint64_t bits[2]{ 0, 0 };
+            std::memcpy(&bits[0], &assets.asset(id).rate, sizeof(bits[0]));
+            std::memcpy(&bits[1], &assets.asset(id).flowShare, sizeof(bits[1]));
+            hash = counterHash(counterHash(hash, bits[0]), bits[1]);
+        }
+        for (const auto& chain : chains)
+        {
+            for (unsigned char c : chain.chainName())
+            {
+                hash = (hash ^ c) * 1099511628211ull;
+            }
+            const Amount values[]{ chain.params().orderflowRegenPerTick, chain.params().outflowRegenPerTick, chain.params().gasCost,
+                chain.params().executionSurplus, chain.maxOrderflowBal, chain.maxOutflowBal, chain.maxStrategyBal };
+            for (Amount value : values)
+            {
+                uint64_t bits{ 0 };
+                std::memcpy(&bits, &value, sizeof(bits));
+                hash = counterHash(hash, bits);
+            }
+            hash = counterHash(hash, chain.params().bridgingTime * 31 + chain.params().inventoryLockTime);
+        }
+        return hash;
+    }
+
+    // Covers the slot's contents as well, so a slot whose pages did not all
+    // reach the file before a crash is not taken for a valid commit
+    static uint64_t checkOf(const CommitRecord& record, uint64_t checksum)
+    {
+        const uint64_t fields = counterHash(record.sequence ^ magic, record.tick * 0x9E3779B97F4A7C15ull + record.locks);
+        return counterHash(fields, checksum) | 1;
+    }
+
+    // FNV-style over the slot's words, in four lanes so the multiplies overlap
+    static uint64_t checksumOf(const char* slot, size_t bytes)
+    {
+        uint64_t lanes[4]{ 1, 2, 3, 4 };
+        const size_t words = bytes / sizeof(uint64_t);
+        size_t i{ 0 };
+        for (; i + 4 <= words; i += 4)
+        {
+            for (size_t k{ 0 }; k < 4; ++k)
+            {
+                uint64_t word{ 0 };
+                std::memcpy(&word, slot + (i + k) * sizeof(uint64_t), sizeof(word));
+                lanes[k] = (lanes[k] ^ word) * 1099511628211ull;
+            }
+        }
+        for (; i < words; ++i)
+        {
+            uint64_t word{ 0 };
+            std::memcpy(&word, slot + i * sizeof(uint64_t), sizeof(word));
+            lanes[0] = (lanes[0] ^ word) * 1099511628211ull;
+        }
+        return counterHash(counterHash(lanes[0], lanes[1]), counterHash(lanes[2], lanes[3]));
+    }
+
+    // Chain records, then the asset amounts, then the pending locks
+    size_t usedBytes(size_t locks) const { return m_chains * sizeof(ChainRecord) + m_assetAmounts * sizeof(Amount) + locks * sizeof(LockRecord); }
+
+    char* slotAt(int k) const { return m_base + slotOffset + k * m_slotBytes; }
+
+    CommitRecord* records() const { return reinterpret_cast<CommitRecord*>(m_base + 64); }
+
+    // The record must match the slot's contents and the per-chain lock
+    // counts must add up to the record's
+    bool valid(int k) const
+    {
+        const CommitRecord& record = records()[k];
+        if (record.check == 0 || record.locks > m_lockCapacity
+            || record.check != checkOf(record, checksumOf(slotAt(k), usedBytes(record.locks))))
+        {
+            return false;
+        }
+
+        const ChainRecord* chainRecords = reinterpret_cast<const ChainRecord*>(slotAt(k));
+        uint64_t locks{ 0 };
+        for (size_t c{ 0 }; c < m_chains; ++c)
+        {
+            if (chainRecords[c].locks > record.locks)
+            {
+                return false;
+            }
+            locks += chainRecords[c].locks;
+        }
+        return locks == record.locks;
+    }
+
+    // -1 when neither record is valid
+    int newestRecord() const
+    {
+        int newest{ -1 };
+        for (int k{ 0 }; k < 2; ++k)
+        {
+            if (valid(k) && (newest < 0 || records()[k].sequence > records()[newest].sequence))
+            {
+                newest = k;
+            }
+        }
+        return newest;
+    }
+
+    const Ticks m_syncInterval;
+    const Ticks m_commitInterval;
+    Ticks m_sinceSync{ 0 };
+    int m_fd{ -1 };
+    char* m_base{ nullptr };
+    size_t m_bytes{ 0 };
+    size_t m_slotBytes{ 0 };
+    size_t m_chains{ 0 };
+    size_t m_lockCapacity{ 0 };
+    size_t m_assetAmounts{ 0 };
+    uint64_t m_sequence{ 1 };
+};
+
+/// Action of a plan, executed offset ticks after the snapshot's tick,
+/// 0 being the tick the snapshot was taken on
+struct PlannedAction
+{
+    Ticks offset;
+    Action action;
+};
+
+using Plan = std::vector<PlannedAction>;
+
+/// Projected state of a chain at the end of a plan's horizon
+struct ChainProjection
+{
+    size_t chain;
+    Amount balance;
+    Amount locked;
+    Amount orderflowBal;
+    Amount outflowBal;
+};
+
+struct PlanProjection
+{
+    std::vector<ChainProjection> chains;    // Only the chains the plan names
+    std::vector<ActionOutcome> outcomes;    // Per planned action
+    Amount total{ 0. };                     // Of all chains
+    uint32_t rejected{ 0 };
+};
+
+/// Scores a short plan of actions against a chains snapshot, e.g. the one a
+/// strategy is given, without forking a simulation. Only the chains the plan
+/// names are followed: their pools regenerate in closed form between the
+/// plan's actions, min(pool + regen * ticks, max), and pending locks are
+/// credited at their release tick. Everything else is taken to stand still,
+/// there is no flow noise, bots or other actions, and only native balances
+/// are planned. The snapshot's total is summed once on construction, so an
+/// evaluation costs time in the length of the plan only. The snapshot must
+/// outlive the evaluator.
+class PlanEvaluator
+{
+public:
+    explicit PlanEvaluator(const Chains& chains)
+        : m_chains(chains)
+    {
+        m_index.reserve(chains.size());
+        for (size_t i{ 0 }; i < chains.size(); ++i)
+        {
+            m_index.emplace(chains[i].chainName(), i);
+
+            Amount lockedTotal(0);
+            for (auto& [locked, ticks] : chains[i].lockedBalances)
+            {
+                lockedTotal += locked;
+            }
+            m_total += chains[i].balance;
+            m_total += lockedTotal;
+        }
+    }
+
+    // The projection is taken horizon ticks on, or at the last planned
+    // action if that is later. It stays valid until the next evaluation.
+    const PlanProjection& evaluate(const Plan& plan, Ticks horizon)
+    {
+        m_projection.chains.clear();
+        m_projection.outcomes.assign(plan.size(), ActionOutcome::executed);
+        m_projection.total = m_total;
+        m_projection.rejected = 0;
+        m_at.clear();
+        m_locks.clear();
+
+        m_order.resize(plan.size());
+        for (size_t k{ 0 }; k < plan.size(); ++k)
+        {
+            m_order[k] = k;
+        }
+        std::stable_sort(m_order.begin(), m_order.end(), [&plan](size_t a, size_t b) { return plan[a].offset < plan[b].offset; });
+
+        for (size_t k : m_order)
+        {
+            horizon = std::max(horizon, plan[k].offset);
+            const ActionOutcome outcome = apply(plan[k]);
+            m_projection.outcomes[k] = outcome;
+            m_projection.rejected += outcome != ActionOutcome::executed;
+        }
+
+        for (size_t i{ 0 }; i < m_projection.chains.size(); ++i)
+        {
+            advance(i, horizon);
+            ChainProjection& projected = m_projection.chains[i];
+            projected.balance += releasedBy(projected.chain, horizon);
+            projected.locked = lockedAfter(projected.chain, horizon);
+        }
+        return m_projection;
+    }
+
+private:
+    struct PlannedLock
+    {
+        size_t chain;
+        Ticks release;
+        Amount amount;
+    };
+
+    static constexpr size_t none = static_cast<size_t>(-1);
+
+    ActionOutcome apply(const PlannedAction& step)
+    {
+        const Action& action = step.action;
+        if (action.source == action.destination)
+        {
+            return ActionOutcome::sameChain;
+        }
+        if (action.sourceAsset != 0 || action.destinationAsset != 0)
+        {
+            return ActionOutcome::unknownAsset;
+        }
+
+        const size_t source = touch(action.source);
+        const size_t destination = touch(action.destination);
+        if (source == none || destination == none)
+        {
+            return ActionOutcome::unknownChain;
+        }
+
+        advance(source, step.offset);
+        advance(destination, step.offset);
+        ChainProjection& from = m_projection.chains[source];
+        ChainProjection& to = m_projection.chains[destination];
+        const ChainParams& params = m_chains[from.chain].params();
+
+        // Same checks, in the same order, as the simulation
+        if (from.balance + releasedBy(from.chain, step.offset) < action.amount)
+        {
+            return ActionOutcome::insufficientBalance;
+        }
+
+        Amount& pool = action.type == Action::type::bridge ? to.outflowBal : to.orderflowBal;
+        if (pool < action.amount)
+        {
+            return ActionOutcome::insufficientPool;
+        }
+        if (action.amount < params.gasCost)
+        {
+            return ActionOutcome::insufficientForGas;
+        }
+
+        pool -= action.amount;
+        from.balance -= action.amount;
+        Amount credited = action.amount - params.gasCost;
+        Ticks lockTime = params.bridgingTime;
+        if (action.type == Action::type::bridge)
+        {
+            from.outflowBal += action.amount;
+        }
+        else
+        {
+            credited *= params.executionSurplus;
+            lockTime = params.inventoryLockTime;
+        }
+
+        // A lock is counted down from the next tick and released on reaching 0
+        m_locks.push_back(PlannedLock{ to.chain, step.offset + std::max<Ticks>(lockTime, 1), credited });
+        m_projection.total += credited - action.amount;
+        return ActionOutcome::executed;
+    }
+
+    // Position of the chain in the projection, added on first use
+    size_t touch(const std::string& name)
+    {
+        auto it = m_index.find(name);
+        if (it == m_index.end())
+        {
+            return none;
+        }
+
+        for (size_t i{ 0 }; i < m_projection.chains.size(); ++i)
+        {
+            if (m_projection.chains[i].chain == it->second)
+            {
+                return i;
+            }
+        }
+
+        const Chain& chain = m_chains[it->second];
+        m_projection.chains.push_back(ChainProjection{ it->second, chain.balance, 0., chain.currentOrderflowBal, chain.currentOutflowBal });
+        m_at.push_back(0);
+        return m_projection.chains.size() - 1;
+    }
+
+    void advance(size_t i, Ticks offset)
+    {
+        if (offset <= m_at[i])
+        {
+            return;
+        }
+
+        ChainProjection& projected = m_projection.chains[i];
+        const Chain& chain = m_chains[projected.chain];
+        const Amount ticks = static_cast<Amount>(offset - m_at[i]);
+        projected.orderflowBal = std::min(projected.orderflowBal + chain.params().orderflowRegenPerTick * ticks, chain.maxOrderflowBal);
+        projected.outflowBal = std::min(projected.outflowBal + chain.params().outflowRegenPerTick * ticks, chain.maxOutflowBal);
+        m_at[i] = offset;
+    }
+
+    Amount releasedBy(size_t chain, Ticks offset) const
+    {
+        Amount released{ 0. };
+        for (const auto& [amount, ticks] : m_chains[chain].lockedBalances)
+        {
+            released += std::max<Ticks>(ticks, 1) <= offset ? amount : 0.;
+        }
+        for (const auto& lock : m_locks)
+        {
+            released += lock.chain == chain && lock.release <= offset ? lock.amount : 0.;
+        }
+        return released;
+    }
+
+    Amount lockedAfter(size_t chain, Ticks offset) const
+    {
+        Amount locked{ 0. };
+        for (const auto& [amount, ticks] : m_chains[chain].lockedBalances)
+        {
+            locked += std::max<Ticks>(ticks, 1) > offset ? amount : 0.;
+        }
+        for (const auto& lock : m_locks)
+        {
+            locked += lock.chain == chain && lock.release > offset ? lock.amount : 0.;
+        }
+        return locked;
+    }
+
+    const Chains& m_chains;
+    ChainIndex m_index;
+    Amount m_total{ 0. };
+
+    PlanProjection m_projection;
+    std::vector<Ticks> m_at;        // Tick each projected chain's pools are at
+    std::vector<PlannedLock> m_locks;
+    std::vector<size_t> m_order;
+};
+
+class IStrategy
+{
+public:
+    virtual ~IStrategy() = default;
+
+    virtual void onTickRecalc(const Chains& chains, Actions& actions) = 0;
+
+    // Called instead of onTickRecalc once the simulation holds non-native assets
+    virtual void onTickRecalcMultiAsset(const Chains& chains, const AssetMatrix& assets, Actions& actions)
+    {
+        (void)assets;
+        onTickRecalc(chains, actions);
+    }
+};
+
+class Simulation
+{
+public:
+
+    explicit Simulation(IStrategy* strategy)
+        : Simulation(strategy, defaultSharedScenario())
+    { }
+
+    Simulation(IStrategy* strategy, const Scenario& scenario)
+        : Simulation(strategy, shareScenario(scenario))
+    { }
+
+    // Only the chains named in overrides get params of their own, the rest
+    // reference the shared scenario
+    Simulation(IStrategy* strategy, SharedScenario scenario, const std::vector<ParamOverride>& overrides = {})
+        : m_strategy(strategy)
+        , m_scenario(std::move(scenario))
+    {
+        initRoutes(overrides);
+    }
+
+    // Shadow copy of a chains snapshot, e.g. the one a strategy is given.
+    // It gets scenario data of its own so it does not depend on the
+    // simulation the snapshot came from.
+    Simulation(IStrategy* strategy, const Chains& chains)
+        : m_strategy(strategy)
+        , m_scenario(shareScenario(specsOf(chains)))
+    {
+        initRoutes({});
+        copyMutableState(chains);
+    }
+
+    ~Simulation() = default;
+
+    // Per tick and per action logging, on by default
+    void setVerbose(bool verbose) { m_verbose = verbose; }
+
+    // Replaces regen rates with the recorded inflows, the simulation tick is
+    // used as the trace tick. Fails, leaving no trace attached, when the
+    // trace names a chain the scenario does not have.
+    bool setFlowTrace(const FlowTrace* trace)
+    {
+        m_flowTrace = nullptr;
+        m_traceColumns.assign(m_chains.size(), -1);
+        if (!trace)
+        {
+            return true;
+        }
+
+        for (size_t i{ 0 }; i < trace->chainNames.size(); ++i)
+        {
+            auto it = m_scenario->index.find(trace->chainNames[i]);
+            if (it == m_scenario->index.end())
+            {
+                m_traceColumns.assign(m_chains.size(), -1);
+                return false;
+            }
+            m_traceColumns[it->second] = static_cast<int>(i);
+        }
+        m_flowTrace = trace;
+        return true;
+    }
+
+    // Adds Gaussian noise to the regen of each chain's pools, drawn from a
+    // counter-based generator keyed on the seed, tick and chain. Pools are
+    // kept between 0 and their maximum.
+    void setFlowNoise(std::vector<FlowNoise> noise, uint64_t seed)
+    {
+        m_noise = std::move(noise);
+        m_noise.resize(m_noise.empty() ? 0 : m_chains.size());
+        m_noiseSeed = seed;
+    }
+
+    // Draws the noise from a factor model from now on, so chains loading on
+    // the same factors get correlated shocks. The model must have a row per
+    // chain, and is shared read-only between simulations.
+    bool setFlowFactors(std::shared_ptr<const FlowFactorModel> model)
+    {
+        if (model && model->chains() != m_chains.size())
+        {
+            return false;
+        }
+
+        m_factors = std::move(model);
+        m_shocks.assign(m_factors ? 2 * m_chains.size() : 0, 0.);
+        return true;
+    }
+
+    // Gives the flows from the current tick on a different random stream,
+    // e.g. for clones of a trajectory
+    void reseedFlowNoise(uint64_t seed) { m_noiseSeed = seed; }
+
+    Ticks currentTick() const { return m_tick; }
+
+    // Moves the clock without touching state, e.g. to start at a trace offset
+    void setCurrentTick(Ticks tick) { m_tick = tick; }
+
+    // Runs ticks without reporting state. Returns the ticks run, which fall
+    // short when a persistent commit failed: the run stops after that tick
+    // rather than carry on past what resume() could restore.
+    Ticks advance(Ticks iterations)
+    {
+        Ticks t{ 0 };
+        for (; t < iterations && !m_persistFailed; ++t)
+        {
+            tick(m_tick++);
+        }
+        return t;
+    }
+
+    const Chains& chains() const { return m_chains; }
+
+    // Background fillers consuming order flow and bridging pools each tick
+    void setBotPopulation(const BotPopulation* bots, BotPhase phase = BotPhase::beforeStrategy)
+    {
+        m_bots = bots;
+        m_botPhase = phase;
+    }
+
+    // What this simulation's bots took from the pools so far
+    const BotFills& botFills() const { return m_botFills; }
+
+    // Runs native pool regeneration and, while not verbose, native actions
+    // through an engine compiled for the current chains and params. Returns
+    // false and keeps the generic engine when one cannot be built.
+    bool specialize(EngineCache& cache)
+    {
+        m_engine = cache.get(m_chains);
+        return m_engine != nullptr;
+    }
+
+    // Keeps the last ticks in the recorder's ring from now on, dumping them
+    // when its anomaly predicate fires
+    void setFlightRecorder(FlightRecorder* recorder)
+    {
+        m_recorder = recorder;
+        if (recorder)
+        {
+            recorder->reset(m_chains.size());
+        }
+    }
+
+    // Records the actions executed on each tick, after netting, from now on
+    void setJournal(ActionJournal* journal)
+    {
+        m_journal = journal;
+        if (journal)
+        {
+            journal->firstTick = m_tick;
+        }
+    }
+
+    // Commits the chains and assets to the mapping at the end of every tick
+    // from now on. Fails, attaching nothing, when the mapping was opened for
+    // state of another shape, e.g. before assets were added. The strategy's
+    // own state is not kept.
+    bool setPersistentState(PersistentState* state)
+    {
+        m_persistent = nullptr;
+        m_persistFailed = false;
+        if (state && !state->fits(m_chains, m_assets))
+        {
+            return false;
+        }
+
+        m_persistent = state;
+        return true;
+    }
+
+    // Continues from the last tick committed to the mapping, if any
+    bool resume(const PersistentState& state)
+    {
+        Ticks tick{ 0 };
+        if (!state.recover(m_chains, m_assets, tick))
+        {
+            return false;
+        }
+
+        m_tick = tick;
+        log() << "Resumed at tick [" << tick << "]" << std::endl;
+        return true;
+    }
+
+    // Runs the next tick executing journaled actions instead of calling the strategy
+    void replayTick(const ResolvedAction* begin, const ResolvedAction* end)
+    {
+        const Ticks tickCounter = m_tick++;
+        regenerate(tickCounter);
+        if (m_bots)
+        {
+            // Replayed ticks were counted when they first ran
+            BotFills replayed;
+            m_bots->consume(m_chains, replayed);
+        }
+        for (const ResolvedAction* action = begin; action != end; ++action)
+        {
+            executeResolved(*action, tickCounter);
+        }
+    }
+
+    SimulationState checkpoint() const
+    {
+        return SimulationState{ m_chains, m_assets, m_tick, m_scenario, m_overriddenParams };
+    }
+
+    // Fails for a state taken from a simulation of another scenario. Params
+    // stay those of this simulation, overrides included.
+    bool restore(const SimulationState& state)
+    {
+        if (state.scenario != m_scenario || state.chains.size() != m_chains.size()
+            || state.assets.assetCount() != m_assets.assetCount())
+        {
+            return false;
+        }
+
+        copyMutableState(state.chains);
+        m_assets = state.assets;
+        m_tick = state.tick;
+        return true;
+    }
+
+    // Sum of balances and locked amounts over all chains, in native terms
+    Amount total() const
+    {
+        Amount total{ 0. };
+
+        for (auto& chain : m_chains)
+        {
+            Amount lockedTotal(0);
+            for (auto& [locked, ticks] : chain.lockedBalances)
+            {
+                lockedTotal += locked;
+            }
+            total += chain.balance;
+            total += lockedTotal;
+        }
+
+        for (AssetId asset{ 1 }; asset < m_assets.assetCount(); ++asset)
+        {
+            total += (m_assets.balanceTotal(asset) + m_assets.lockedTotal(asset)) * m_assets.rate(asset);
+        }
+
+        return total;
+    }
+
+    AssetId addAsset(AssetParams params)
+    {
+        return m_assets.addAsset(std::move(params), m_chains);
+    }
+
+    bool setAssetState(const std::string& chainName, AssetId asset, Amount initialOrderflowBal,
+        Amount initialOutflowBal, Amount startingBal)
+    {
+        auto it = m_scenario->index.find(chainName);
+        if (it == m_scenario->index.end() || asset == 0 || asset >= m_assets.assetCount())
+        {
+            return false;
+        }
+
+        m_assets.setState(it->second, asset, initialOrderflowBal, initialOutflowBal, startingBal);
+        return true;
+    }
+
+    const AssetMatrix& assets() const { return m_assets; }
+
+    // Nets opposing bridges and coalesces same-route actions emitted on a tick
+    // before they are executed
+    void setActionNetting(bool enabled) { m_netActions = enabled; }
+    const NettingStats& nettingStats() const { return m_nettingStats; }
+
+    // Records tick phases, strategy calls and actions as trace-event spans,
+    // events past maxEvents are dropped rather than growing the buffer
+    void enableTracing(size_t maxEvents = 1 << 20) { m_trace.enable(maxEvents); }
+
+    bool writeTrace(const std::string& path) const
+    {
+        if (m_trace.dropped())
+        {
+            std::cout << "Trace buffer full, dropped [" << m_trace.dropped() << "] events" << std::endl;
+        }
+        return m_trace.write(path);
+    }
+
+    // Collects hardware counters per tick phase and strategy call, reported
+    // at the end of simulate(). Returns false and leaves the run unaffected
+    // when counters are not available.
+    bool enablePerfCounters()
+    {
+        if (m_counters.enable())
+        {
+            return true;
+        }
+
+        log() << "Performance counters unavailable, continuing without them" << std::endl;
+        return false;
+    }
+
+    void reportPerfCounters(std::ostream& out) const { m_counters.report(out); }
+
+    void simulate(uint64_t iterations)
+    {
+        reportState();
+
+        std::cout << "Starting simulation.." << std::endl;
+
+        for (uint64_t t{ 0 }; t < iterations && !m_persistFailed; ++t)
+        {
+            tick(m_tick++);
+        }
+
+        std::cout << "..finished." << std::endl;
+
+        if (m_netActions)
+        {
+            std::cout << "Netting: [" << m_nettingStats.actionsIn << "] actions in, ["
+                      << m_nettingStats.actionsOut << "] out, gas saved [" << m_nettingStats.gasSaved << "], ["
+                      << m_nettingStats.rejected << "] combined actions rejected" << std::endl;
+        }
+
+        if (m_counters.enabled())
+        {
+            m_counters.report(std::cout);
+        }
+
+        reportState();
+    }
+
+private:
+    void initRoutes(const std::vector<ParamOverride>& overrides)
+    {
+        auto overridden = std::make_shared<std::deque<ChainParams>>();
+        m_chains = buildChains(*m_scenario, overrides, *overridden);
+        m_overriddenParams = std::move(overridden);
+    }
+
+    static Scenario specsOf(const Chains& chains)
+    {
+        Scenario scenario;
+        for (const auto& chain : chains)
+        {
+            scenario.push_back(ChainSpec{ chain.chainName(), chain.params(), chain.currentOrderflowBal, chain.currentOutflowBal,
+                chain.currentStrategyBal, chain.maxOrderflowBal, chain.maxOutflowBal });
+        }
+        return scenario;
+    }
+
+    // Chains built from the same scenario differ only in these fields
+    void copyMutableState(const Chains& chains)
+    {
+        for (size_t i{ 0 }; i < m_chains.size() && i < chains.size(); ++i)
+        {
+            m_chains[i].currentOrderflowBal = chains[i].currentOrderflowBal;
+            m_chains[i].currentOutflowBal = chains[i].currentOutflowBal;
+            m_chains[i].currentStrategyBal = chains[i].currentStrategyBal;
+            m_chains[i].balance = chains[i].balance;
+            m_chains[i].lockedBalances = chains[i].lockedBalances;
+        }
+    }
+
+    bool multiAsset() const { return m_assets.assetCount() > 1; }
+
+    // Rebuilt when the chains moved, e.g. in a copy of this simulation
+    double* const* engineFields()
+    {
+        if (m_engineFieldsOf != m_chains.data())
+        {
+            SpecializedEngine::fieldsOf(m_chains, m_engineFields);
+            m_engineFieldsOf = m_chains.data();
+        }
+        return m_engineFields.data();
+    }
+
+    Amount& balanceOf(size_t chain, AssetId asset)
+    {
+        return asset == 0 ? m_chains[chain].balance : m_assets.balance(chain, asset);
+    }
+
+    Amount& orderflowBalOf(size_t chain, AssetId asset)
+    {
+        return asset == 0 ? m_chains[chain].currentOrderflowBal : m_assets.orderflowBal(chain, asset);
+    }
+
+    Amount& outflowBalOf(size_t chain, AssetId asset)
+    {
+        return asset == 0 ? m_chains[chain].currentOutflowBal : m_assets.outflowBal(chain, asset);
+    }
+
+    void lock(size_t chain, AssetId asset, Amount amount, Ticks ticks, Ticks now)
+    {
+        if (asset == 0)
+        {
+            m_chains[chain].lockedBalances.push_back({ amount, ticks });
+        }
+        else
+        {
+            m_assets.lock(chain, asset, amount, ticks, now);
+        }
+    }
+
+    void tick(uint64_t tickCounter)
+    {
+        if (tickCounter % 100 == 0)
+        {
+            log() << "... [" << tickCounter << "] ..." << std::endl;
+        }
+
+        const auto tickStart = m_trace.now();
+        ROUTESIM_PROBE(tick_start, tickCounter);
+
+        const auto regenCounters = m_counters.read();
+        regenerate(tickCounter);
+        m_counters.add(CounterPhase::regen, regenCounters);
+        ROUTESIM_PROBE(regen_done, tickCounter);
+        m_trace.span("regen", "phase", tickStart, tickCounter);
+
+        Actions actions;
+        decide(tickCounter, actions);
+        const uint32_t rejected = execute(tickCounter, actions);
+        m_trace.span("tick", "tick", tickStart, tickCounter);
+        endTick(tickCounter, actions.size(), rejected);
+    }
+
+    // Bots and the strategy, leaving the actions to execute
+    void decide(uint64_t tickCounter, Actions& actions)
+    {
+        if (m_bots && m_botPhase == BotPhase::beforeStrategy)
+        {
+            const auto botsStart = m_trace.now();
+            const auto botsCounters = m_counters.read();
+            m_bots->consume(m_chains, m_botFills);
+            m_counters.add(CounterPhase::bots, botsCounters);
+            m_trace.span("bots", "phase", botsStart, tickCounter);
+        }
+
+        // Trigger the simualate method
+        const auto strategyStart = m_trace.now();
+        ROUTESIM_PROBE(strategy_start, tickCounter);
+        const auto strategyCounters = m_counters.read();
+        if (multiAsset())
+        {
+            m_strategy->onTickRecalcMultiAsset(m_chains, m_assets, actions);
+        }
+        else
+        {
+            m_strategy->onTickRecalc(m_chains, actions);
+        }
+        m_counters.add(CounterPhase::strategy, strategyCounters);
+        ROUTESIM_PROBE(strategy_done, tickCounter);
+        m_trace.span("onTickRecalc", "strategy", strategyStart, tickCounter);
+
+        if (m_netActions)
+        {
+            const auto nettingStart = m_trace.now();
+            const auto nettingCounters = m_counters.read();
+            netActions(actions);
+            m_counters.add(CounterPhase::netting, nettingCounters);
+            m_trace.span("netting", "phase", nettingStart, tickCounter);
+        }
+
+        if (m_bots && m_botPhase == BotPhase::alongsideStrategy)
+        {
+            const auto botsStart = m_trace.now();
+            const auto botsCounters = m_counters.read();
+            m_bots->consume(m_chains, m_botFills);
+            m_counters.add(CounterPhase::bots, botsCounters);
+            m_trace.span("bots", "phase", botsStart, tickCounter);
+        }
+    }
+
+    // Returns the number of actions rejected
+    uint32_t execute(uint64_t tickCounter, const Actions& actions)
+    {
+        if (m_journal)
+        {
+            m_journal->beginTick();
+        }
+
+        // Execution strategy actions
+        const auto executeStart = m_trace.now();
+        ROUTESIM_PROBE(execute_start, tickCounter);
+        const auto executeCounters = m_counters.read();
+        uint32_t rejected{ 0 };
+        // Netting leaves a flag per action it kept, set where it combined several
+        const bool netted = m_netActions && m_combined.size() == actions.size();
+        for (size_t k{ 0 }; k < actions.size(); ++k)
+        {
+            const Action& action = actions[k];
+            const auto actionStart = m_trace.now();
+            const bool failed = executeAction(action, tickCounter) != ActionOutcome::executed;
+            rejected += failed;
+            m_nettingStats.rejected += failed && netted && m_combined[k];
+            m_trace.span(action.type == Action::type::bridge ? "bridge" : "execute", "action", actionStart, tickCounter);
+        }
+        m_counters.add(CounterPhase::execute, executeCounters);
+        ROUTESIM_PROBE(execute_done, tickCounter);
+        m_trace.span("execute actions", "phase", executeStart, tickCounter);
+        return rejected;
+    }
+
+    void endTick(uint64_t tickCounter, size_t actions, uint32_t rejected)
+    {
+        if (m_recorder)
+        {
+            const Amount recorded = m_recorder->usesTotal() ? total() : std::numeric_limits<Amount>::quiet_NaN();
+            const std::string dumped = m_recorder->endTick(tickCounter, static_cast<uint32_t>(actions), rejected, recorded, m_chains);
+            if (!dumped.empty())
+            {
+                log() << "[" << tickCounter << "]: !!! Anomaly, flight recorder written to [" << dumped << "]" << std::endl;
+            }
+        }
+
+        if (m_persistent && !m_persistent->commit(m_chains, m_assets, tickCounter + 1))
+        {
+            std::cout << "[" << tickCounter << "]: !!! Failed to commit persistent state, stopping at tick ["
+                      << tickCounter + 1 << "]" << std::endl;
+            m_persistFailed = true;
+        }
+        ROUTESIM_PROBE(tick_done, tickCounter);
+    }
+
+    void regenerate(uint64_t tickCounter)
+    {
+        // Recorded flows vary per tick so they need the generic path
+        const bool specialized = m_engine && !m_flowTrace && m_noise.empty();
+        if (specialized)
+        {
+            m_engine->regenerate(engineFields());
+        }
+
+        if (m_factors && !m_noise.empty())
+        {
+            m_factors->sample(m_noiseSeed, tickCounter, m_shocks.data(), m_shocks.data() + m_chains.size());
+        }
+
+        // Tick pending balances and credit to balance if needed
+        for (size_t i{ 0 }; i < m_chains.size(); ++i)
+        {
+            auto& chain = m_chains[i];
+            if (specialized)
+            {
+                releaseLocked(chain, tickCounter);
+                continue;
+            }
+
+            Amount orderflowRegen = chain.params().orderflowRegenPerTick;
+            Amount outflowRegen = chain.params().outflowRegenPerTick;
+            if (m_flowTrace && m_traceColumns[i] >= 0 && tickCounter < m_flowTrace->length)
+            {
+                const Amount recordedOrderflow = m_flowTrace->orderflow(tickCounter, m_traceColumns[i]);
+                const Amount recordedOutflow = m_flowTrace->outflow(tickCounter, m_traceColumns[i]);
+                orderflowRegen = std::isnan(recordedOrderflow) ? orderflowRegen : recordedOrderflow;
+                outflowRegen = std::isnan(recordedOutflow) ? outflowRegen : recordedOutflow;
+            }
+
+            chain.currentOrderflowBal = std::min(
+                chain.currentOrderflowBal + orderflowRegen,
+                chain.maxOrderflowBal);
+
+            chain.currentOutflowBal = std::min(chain.currentOutflowBal + outflowRegen,
+                chain.maxOutflowBal);
+
+            if (!m_noise.empty())
+            {
+                addNoise(chain, i, tickCounter);
+            }
+
+            releaseLocked(chain, tickCounter);
+        }
+
+        m_assets.regenerate(tickCounter);
+    }
+
+    void addNoise(Chain& chain, size_t index, uint64_t tickCounter)
+    {
+        const uint64_t counter = (tickCounter * m_chains.size() + index) * 2;
+        const Amount orderflowShock = m_factors ? m_shocks[index] : counterNormal(m_noiseSeed, counter);
+        const Amount outflowShock = m_factors ? m_shocks[m_chains.size() + index] : counterNormal(m_noiseSeed, counter + 1);
+        const Amount orderflow = chain.currentOrderflowBal + m_noise[index].orderflowStd * orderflowShock;
+        const Amount outflow = chain.currentOutflowBal + m_noise[index].outflowStd * outflowShock;
+        chain.currentOrderflowBal = std::min(std::max(orderflow, 0.), chain.maxOrderflowBal);
+        chain.currentOutflowBal = std::min(std::max(outflow, 0.), chain.maxOutflowBal);
+    }
+
+    void releaseLocked(Chain& chain, uint64_t tickCounter)
+    {
+        chain.lockedBalances.erase(
+            std::remove_if(
+                chain.lockedBalances.begin(),
+                chain.lockedBalances.end(),
+                [this, &chain, &tickCounter](auto& pendingBal) {
+                    auto& [balance, ticks] = pendingBal;
+                    if (ticks > 0) {
+                        --ticks;
+                    }
+
+                    if (ticks == 0) {
+                        chain.balance += balance;
+                        log() << "[" << tickCounter << "]: amount [" << balance << "] now available on "
+                                  << "chain [" << chain.chainName() << "]" << std::endl;
+                        // Mark for removal
+                        return true; 
+                    }
+                    return false;
+                }),
+            chain.lockedBalances.end());
+    }
+
+    ActionOutcome executeAction(const Action& action, uint64_t tickCounter)
+    {
+        if (action.source == action.destination)
+        {
+            log() << "[" << tickCounter << "]: !!! Failed to execute action, chains can't be the same" << std::endl;
+            return rejectUnresolved(action, tickCounter, ActionOutcome::sameChain);
+        }
+
+        // get source + destination chains
+        auto sourceIt = m_scenario->index.find(action.source);
+        auto destinationIt = m_scenario->index.find(action.destination);
+
+        if (sourceIt == m_scenario->index.end() || destinationIt == m_scenario->index.end())
+        {
+            log() << "[" << tickCounter << "]: !!! Failed to find chain, skipping action" << std::endl;
+            return rejectUnresolved(action, tickCounter, ActionOutcome::unknownChain);
+        }
+
+        if (action.sourceAsset >= std::min<size_t>(m_assets.assetCount(), UINT16_MAX)
+            || action.destinationAsset >= std::min<size_t>(m_assets.assetCount(), UINT16_MAX))
+        {
+            log() << "[" << tickCounter << "]: !!! Failed to find asset, skipping action" << std::endl;
+            return rejectUnresolved(action, tickCounter, ActionOutcome::unknownAsset);
+        }
+
+        const ResolvedAction resolved{
+            action.amount,
+            static_cast<uint32_t>(sourceIt->second),
+            static_cast<uint32_t>(destinationIt->second),
+            static_cast<uint16_t>(action.sourceAsset),
+            static_cast<uint16_t>(action.destinationAsset),
+            action.type
+        };
+
+        if (m_journal)
+        {
+            m_journal->entries.push_back(resolved);
+        }
+
+        const ActionOutcome outcome = executeResolved(resolved, tickCounter);
+        if (m_recorder)
+        {
+            m_recorder->recordAction(tickCounter, resolved, outcome);
+        }
+        return outcome;
+    }
+
+    ActionOutcome rejectUnresolved(const Action& action, uint64_t tickCounter, ActionOutcome outcome)
+    {
+        if (m_recorder)
+        {
+            const ResolvedAction unresolved{ action.amount, FlightRecorder::unresolved, FlightRecorder::unresolved,
+                static_cast<uint16_t>(std::min<size_t>(action.sourceAsset, UINT16_MAX)),
+                static_cast<uint16_t>(std::min<size_t>(action.destinationAsset, UINT16_MAX)), action.type };
+            m_recorder->recordAction(tickCounter, unresolved, outcome);
+        }
+        return outcome;
+    }
+
+    ActionOutcome executeResolved(const ResolvedAction& action, uint64_t tickCounter)
+    {
+        // The specialized engine does not log, so it only runs silent
+        if (m_engine && !m_verbose && action.sourceAsset == 0 && action.destinationAsset == 0)
+        {
+            Amount credited{ 0. };
+            Ticks lockTicks{ 0 };
+            const ActionOutcome outcome = m_engine->execute(engineFields(), action, credited, lockTicks);
+            if (outcome == ActionOutcome::executed)
+            {
+                m_chains[action.destination].lockedBalances.push_back({ credited, lockTicks });
+            }
+            return outcome;
+        }
+
+        const size_t source = action.source;
+        const size_t destination = action.destination;
+        Chain* pSource = &m_chains[source];
+        Chain* pDestination = &m_chains[destination];
+
+        // Amounts are denominated in the source asset, gas is charged in native terms
+        const Amount conversion = m_assets.rate(action.sourceAsset) / m_assets.rate(action.destinationAsset);
+        const Amount gasCost = pSource->params().gasCost / m_assets.rate(action.sourceAsset);
+        const Amount destinationAmount = action.amount * conversion;
+        Amount& sourceBal = balanceOf(source, action.sourceAsset);
+
+        // check balance
+        if (sourceBal < action.amount) {
+            log() << "[" << tickCounter << "]: !!! Insufficient funds for action, skipping action" << std::endl;
+            return ActionOutcome::insufficientBalance;
+        }
+        
+        // Execute action if possible
+        if (action.type == Action::type::bridge)
+        {
+            Amount& destinationOutflowBal = outflowBalOf(destination, action.destinationAsset);
+            if (destinationOutflowBal < destinationAmount) {
+                log() << "[" << tickCounter << "]: !!! Insufficient funds for [bridge] action on destination, skipping action" << std::endl;
+                return ActionOutcome::insufficientPool;
+            }
+
+            if (action.amount < gasCost) {
+                log() << "[" << tickCounter << "]: !!! Insufficient funds to pay for [bridge] action, skipping action" << std::endl;
+                return ActionOutcome::insufficientForGas;
+            }
+
+            const Amount bridgedAmount = (action.amount - gasCost) * conversion;
+            // Destination bridging pool amount reduced
+            destinationOutflowBal -= destinationAmount;
+            // Source bridging pool amount increased
+            outflowBalOf(source, action.sourceAsset) += action.amount;
+            // Strategy balance reduced
+            sourceBal -= action.amount;
+            
+            lock(destination, action.destinationAsset, bridgedAmount, pSource->params().bridgingTime, tickCounter);
+
+            log() << "[" << tickCounter << "]: Bridged from [" << pSource->chainName() << "] to "
+                      << "[" << pDestination->chainName() + "] amount [" << bridgedAmount << "] in "
+                      << "[" << pSource->params().bridgingTime  << "] ticks" << std::endl;
+        }
+        else if (action.type == Action::type::execute)
+        {
+            Amount& destinationOrderflowBal = orderflowBalOf(destination, action.destinationAsset);
+            if (destinationOrderflowBal < destinationAmount) {
+                log() << "[" << tickCounter << "]: !!! Insufficient destination funds for [execute] action, skipping action" << std::endl;
+                return ActionOutcome::insufficientPool;
+            }
+
+            if (action.amount < gasCost) {
+                log() << "[" << tickCounter << "]: !!! Insufficient source funds to pay for [execute] action, skipping action" << std::endl;
+                return ActionOutcome::insufficientForGas;
+            }
+
+            const Amount amountAfterGasCost = action.amount - gasCost;
+            const Amount creditedAmount = amountAfterGasCost * pSource->params().executionSurplus * conversion;
+
+            // Reduce source chain order amount
+            destinationOrderflowBal -= destinationAmount;
+            
+            // Strategy balance reduced
+            sourceBal -= action.amount;
+
+            lock(destination, action.destinationAsset, creditedAmount, pSource->params().inventoryLockTime, tickCounter);
+
+            log() << "[" << tickCounter << "]: Executed order on [" << pSource->chainName() << "] "
+                      << "credited on [" << pDestination->chainName() + "] amount [" << creditedAmount << "] "
+                      << "in [" << pSource->params().inventoryLockTime << "] ticks" << std::endl;
+        }
+        return ActionOutcome::executed;
+    }
+
+    bool nettable(const Action& action) const
+    {
+        return action.source != action.destination
+            && m_scenario->index.count(action.source) && m_scenario->index.count(action.destination)
+            && action.sourceAsset < m_assets.assetCount() && action.destinationAsset < m_assets.assetCount();
+    }
+
+    Amount gasCostOf(const Action& action) const
+    {
+        return m_chains[m_scenario->index.at(action.source)].params().gasCost;
+    }
+
+    // Runs the executor's balance, pool and gas checks for the action on the
+    // dry-run copies of the levels it touches, updating them when it passes
+    bool wouldExecute(const Action& action)
+    {
+        const size_t source = m_scenario->index.at(action.source);
+        const size_t destination = m_scenario->index.at(action.destination);
+        const Amount conversion = m_assets.rate(action.sourceAsset) / m_assets.rate(action.destinationAsset);
+        const Amount gasCost = m_chains[source].params().gasCost / m_assets.rate(action.sourceAsset);
+        const bool bridge = action.type == Action::type::bridge;
+
+        Amount& sourceBal = dryRunLevel(source, action.sourceAsset, 0);
+        Amount& pool = dryRunLevel(destination, action.destinationAsset, bridge ? 1 : 2);
+        if (sourceBal < action.amount || pool < action.amount * conversion || action.amount < gasCost)
+        {
+            return false;
+        }
+
+        sourceBal -= action.amount;
+        pool -= action.amount * conversion;
+        if (bridge)
+        {
+            dryRunLevel(source, action.sourceAsset, 1) += action.amount;
+        }
+        return true;
+    }
+
+    // Level 0 is the balance, 1 the bridging pool and 2 the order flow pool,
+    // read from the simulation on first use in a tick
+    Amount& dryRunLevel(size_t chain, AssetId asset, int level)
+    {
+        const uint64_t key = (static_cast<uint64_t>(chain) * m_assets.assetCount() + asset) * 3 + level;
+        auto it = m_dryRun.find(key);
+        if (it == m_dryRun.end())
+        {
+            const Amount value = level == 0 ? balanceOf(chain, asset) : level == 1 ? outflowBalOf(chain, asset) : orderflowBalOf(chain, asset);
+            it = m_dryRun.emplace(key, value).first;
+        }
+        return it->second;
+    }
+
+    // Coalesces executes on the same route and asset pair, and sums bridges
+    // on the same route in either direction into a single bridge of the net
+    // value. Only actions which pass the executor's checks when the tick's
+    // actions run in order are merged, and only their gas counts as saved;
+    // actions the executor would reject are passed through untouched.
+    void netActions(Actions& actions)
+    {
+        m_dryRun.clear();
+        m_netted.clear();
+        m_nettedReverse.clear();
+        m_nettedMergeable.clear();
+        m_nettedLast.clear();
+        m_nettedCombined.clear();
+
+        const size_t actionsIn = actions.size();
+        Amount gasBefore{ 0. };
+        for (size_t k{ 0 }; k < actions.size(); ++k)
+        {
+            const Action& action = actions[k];
+            const bool mergeable = nettable(action) && wouldExecute(action);
+            size_t i{ 0 };
+            if (mergeable)
+            {
+                gasBefore += gasCostOf(action);
+
+                for (; i < m_netted.size(); ++i)
+                {
+                    const Action& entry = m_netted[i];
+                    if (!m_nettedMergeable[i] || entry.type != action.type)
+                    {
+                        continue;
+                    }
+
+                    if (entry.source == action.source && entry.destination == action.destination
+                        && entry.sourceAsset == action.sourceAsset && entry.destinationAsset == action.destinationAsset)
+                    {
+                        m_netted[i].amount += action.amount;
+                        m_nettedLast[i] = k;
+                        m_nettedCombined[i] = true;
+                        break;
+                    }
+
+                    if (action.type == Action::type::bridge
+                        && entry.source == action.destination && entry.destination == action.source
+                        && entry.sourceAsset == action.destinationAsset && entry.destinationAsset == action.sourceAsset)
+                    {
+                        m_nettedReverse[i] += action.amount;
+                        m_nettedLast[i] = k;
+                        m_nettedCombined[i] = true;
+                        break;
+                    }
+                }
+            }
+
+            if (!mergeable || i == m_netted.size())
+            {
+                m_netted.push_back(action);
+                m_nettedReverse.push_back(0.);
+                m_nettedMergeable.push_back(mergeable);
+                m_nettedLast.push_back(k);
+                m_nettedCombined.push_back(false);
+            }
+        }
+
+        // Combined actions run where their last part was, so every action
+        // the strategy placed before any part of them still runs first
+        m_nettedOrder.resize(m_netted.size());
+        for (size_t i{ 0 }; i < m_netted.size(); ++i)
+        {
+            m_nettedOrder[i] = i;
+        }
+        std::sort(m_nettedOrder.begin(), m_nettedOrder.end(), [this](size_t a, size_t b) { return m_nettedLast[a] < m_nettedLast[b]; });
+
+        actions.clear();
+        m_combined.clear();
+        Amount gasAfter{ 0. };
+        for (size_t i : m_nettedOrder)
+        {
+            Action& action = m_netted[i];
+            if (m_nettedReverse[i] > 0.)
+            {
+                // Compare both directions in native terms and keep the surplus one
+                const Amount forward = action.amount * m_assets.rate(action.sourceAsset);
+                const Amount reverse = m_nettedReverse[i] * m_assets.rate(action.destinationAsset);
+                if (forward == reverse)
+                {
+                    continue;
+                }
+
+                if (reverse > forward)
+                {
+                    std::swap(action.source, action.destination);
+                    std::swap(action.sourceAsset, action.destinationAsset);
+                }
+                action.amount = std::abs(forward - reverse) / m_assets.rate(action.sourceAsset);
+            }
+
+            if (m_nettedMergeable[i])
+            {
+                gasAfter += gasCostOf(action);
+            }
+            actions.push_back(std::move(action));
+            m_combined.push_back(m_nettedCombined[i]);
+        }
+
+        m_nettingStats.actionsIn += actionsIn;
+        m_nettingStats.actionsOut += actions.size();
+        m_nettingStats.gasSaved += gasBefore - gasAfter;
+    }
+
+    std::ostream& log()
+    {
+        return m_verbose ? std::cout : m_silent;
+    }
+
+    void reportState()
+    {
+        // output result of value changes
+        for (auto& chain : m_chains)
+        {
+            Amount lockedTotal(0);
+            for (auto& [locked, ticks] : chain.lockedBalances)
+            {
+                lockedTotal += locked;
+            }
+            std::cout << "Chain [" << chain.chainName() << "] balance [" << chain.balance << "] + locked [" << lockedTotal << "]" << std::endl;
+        }
+
+        for (AssetId asset{ 1 }; asset < m_assets.assetCount(); ++asset)
+        {
+            std::cout << "Asset [" << m_assets.asset(asset).symbol << "] balance [" << m_assets.balanceTotal(asset)
+                      << "] + locked [" << m_assets.lockedTotal(asset) << "] at rate [" << m_assets.rate(asset) << "]" << std::endl;
+        }
+
+        std::cout << "Total : " << total() << std::endl;
+    }
+
+    IStrategy* m_strategy;
+
+    SharedScenario m_scenario;
+    std::shared_ptr<const std::deque<ChainParams>> m_overriddenParams;
+    Chains m_chains;
+    AssetMatrix m_assets;
+
+    bool m_netActions{ false };
+    NettingStats m_nettingStats;
+    Actions m_netted;
+    std::vector<Amount> m_nettedReverse;
+    std::vector<char> m_nettedMergeable;
+    std::vector<size_t> m_nettedLast;       // Position of the last action merged into each
+    std::vector<char> m_nettedCombined;
+    std::vector<size_t> m_nettedOrder;
+    std::vector<char> m_combined;           // Per netted action, whether it combines several
+    std::unordered_map<uint64_t, Amount> m_dryRun;
+
+    TraceRecorder m_trace;
+    PerfCounters m_counters;
+
+    ActionJournal* m_journal{ nullptr };
+    FlightRecorder* m_recorder{ nullptr };
+    PersistentState* m_persistent{ nullptr };
+    bool m_persistFailed{ false };  // Stops advance() until the state is attached again
+    std::shared_ptr<const SpecializedEngine> m_engine;
+    std::vector<double*> m_engineFields;
+    const Chain* m_engineFieldsOf{ nullptr };
+
+    const BotPopulation* m_bots{ nullptr };
+    BotFills m_botFills;
+    BotPhase m_botPhase{ BotPhase::beforeStrategy };
+
+    Ticks m_tick{ 0 };
+    bool m_verbose{ true };
+    std::ostream m_silent{ nullptr };
+
+    const FlowTrace* m_flowTrace{ nullptr };
+    std::vector<int> m_traceColumns;
+    std::vector<FlowNoise> m_noise;
+    uint64_t m_noiseSeed{ 0 };
+    std::shared_ptr<const FlowFactorModel> m_factors;
+    std::vector<Amount> m_shocks;   // Order flow, then bridging pool, of the current tick
+};
+
+/// Records a run as periodic checkpoints plus the action journal, then moves
+/// the simulation to any recorded tick by restoring the nearest checkpoint
+/// at or before it and replaying journaled actions forward, without calling
+/// the strategy. Seeking costs at most checkpointInterval replayed ticks.
+class TimeTravelDebugger
+{
+public:
+    explicit TimeTravelDebugger(Simulation& sim, Ticks checkpointInterval = 4096)
+        : m_sim(sim)
+        , m_interval(std::max<Ticks>(checkpointInterval, 1))
+    { }
+
+    // Runs the strategy for iterations ticks from the current state
+    void record(Ticks iterations)
+    {
+        m_checkpoints.clear();
+        m_journal = ActionJournal{};
+        m_sim.setJournal(&m_journal);
+        m_start = m_sim.currentTick();
+
+        for (Ticks t{ 0 }; t < iterations; ++t)
+        {
+            if (t % m_interval == 0)
+            {
+                m_checkpoints.push_back(m_sim.checkpoint());
+            }
+            m_sim.advance(1);
+        }
+
+        m_sim.setJournal(nullptr);
+        m_end = m_sim.currentTick();
+    }
+
+    Ticks firstTick() const { return m_start; }
+    Ticks lastTick() const { return m_end; }
+    Ticks position() const { return m_sim.currentTick(); }
+
+    // Actions the strategy issued on a recorded tick
+    std::pair<const ResolvedAction*, const ResolvedAction*> actionsAt(Ticks tick) const
+    {
+        return { m_journal.begin(tick), m_journal.end(tick) };
+    }
+
+    // Leaves the simulation in the state at the start of tick
+    bool seek(Ticks tick)
+    {
+        if (tick < m_start || tick > m_end || m_checkpoints.empty())
+        {
+            return false;
+        }
+
+        const Ticks current = m_sim.currentTick();
+        // The end of a run whose length is a multiple of the interval has
+        // no checkpoint of its own
+        const size_t nearest = std::min(static_cast<size_t>((tick - m_start) / m_interval), m_checkpoints.size() - 1);
+        const bool replayFromCurrent = current <= tick && current >= m_start + nearest * m_interval;
+        if (!replayFromCurrent)
+        {
+            m_sim.restore(m_checkpoints[nearest]);
+        }
+
+        while (m_sim.currentTick() < tick)
+        {
+            const Ticks t = m_sim.currentTick();
+            m_sim.replayTick(m_journal.begin(t), m_journal.end(t));
+        }
+        return true;
+    }
+
+    bool stepForward() { return seek(position() + 1); }
+    bool stepBackward() { return position() > m_start && seek(position() - 1); }
+
+private:
+    Simulation& m_sim;
+    const Ticks m_interval;
+    Ticks m_start{ 0 };
+    Ticks m_end{ 0 };
+    std::vector<SimulationState> m_checkpoints;
+    ActionJournal m_journal;
+};
+
+using StrategyFactory = std::function<std::unique_ptr<IStrategy>()>;
+
+struct WalkForwardConfig
+{
+    Ticks windowLength;
+    Ticks step;             // Ticks between window starts
+    Ticks warmup;           // Ticks run before each window and excluded from its result
+    bool shareWarmup;       // Run one pass over the trace and start every window from its checkpoint, see WalkForwardRunner
+};
+
+struct WindowResult
+{
+    Ticks start;
+    Amount startTotal;
+    Amount endTotal;
+};
+
+struct WalkForwardReport
+{
+    bool valid{ false };            // False when the trace names a chain the scenario lacks, nothing is run then
+    std::vector<WindowResult> windows;
+    Amount meanGain{ 0. };
+    Amount stddevGain{ 0. };
+    Amount worstGain{ 0. };
+    Amount bestGain{ 0. };
+};
+
+/// Evaluates a strategy over rolling windows of a flow trace. Each window
+/// runs in its own simulation with its own strategy instance on the batch
+/// runner. Without shared warm-up every window replays its warm-up ticks
+/// from the initial state. With it a single pass over the trace, run on the
+/// calling thread before any window, checkpoints the state at each window
+/// start and the windows resume from those checkpoints. That changes what a
+/// window starts from: window k carries the chain state of the whole trace
+/// before it, warmup ticks for the first window plus k steps, rather than
+/// warmup ticks from the initial balances. Only the chain state carries
+/// over, each window's strategy is a fresh instance.
+class WalkForwardRunner
+{
+public:
+    // The scenario is the one the trace was recorded on
+    WalkForwardRunner(const FlowTrace& trace, SharedScenario scenario, StrategyFactory factory, BatchRunner& runner,
+        std::vector<ParamOverride> overrides = {})
+        : m_trace(trace)
+        , m_scenario(std::move(scenario))
+        , m_overrides(std::move(overrides))
+        , m_factory(std::move(factory))
+        , m_runner(runner)
+    { }
+
+    WalkForwardReport run(const WalkForwardConfig& config)
+    {
+        WalkForwardReport report;
+        for (const auto& name : m_trace.chainNames)
+        {
+            if (!m_scenario->index.count(name))
+            {
+                return report;
+            }
+        }
+        report.valid = true;
+
+        for (Ticks start = config.warmup; start + config.windowLength <= m_trace.length; start += std::max<Ticks>(config.step, 1))
+        {
+            report.windows.push_back(WindowResult{ start, 0., 0. });
+        }
+
+        std::vector<SimulationState> checkpoints;
+        if (config.shareWarmup && !report.windows.empty())
+        {
+            auto strategy = m_factory();
+            Simulation sim(strategy.get(), m_scenario, m_overrides);
+            sim.setVerbose(false);
+            sim.setFlowTrace(&m_trace);
+            sim.setCurrentTick(report.windows.front().start - config.warmup);
+            for (const auto& window : report.windows)
+            {
+                sim.advance(window.start - sim.currentTick());
+                checkpoints.push_back(sim.checkpoint());
+            }
+        }
+
+        m_runner.run(report.windows.size(), [&](size_t i) {
+            WindowResult& window = report.windows[i];
+            auto strategy = m_factory();
+            Simulation sim(strategy.get(), m_scenario, m_overrides);
+            sim.setVerbose(false);
+            sim.setFlowTrace(&m_trace);
+            if (config.shareWarmup)
+            {
+                sim.restore(checkpoints[i]);
+            }
+            else
+            {
+                sim.setCurrentTick(window.start - config.warmup);
+                sim.advance(config.warmup);
+            }
+
+            window.startTotal = sim.total();
+            sim.advance(config.windowLength);
+            window.endTotal = sim.total();
+        });
+
+        if (report.windows.empty())
+        {
+            return report;
+        }
+
+        report.worstGain = std::numeric_limits<Amount>::max();
+        report.bestGain = std::numeric_limits<Amount>::lowest();
+        for (const auto& window : report.windows)
+        {
+            const Amount gain = window.endTotal - window.startTotal;
+            report.meanGain += gain;
+            report.worstGain = std::min(report.worstGain, gain);
+            report.bestGain = std::max(report.bestGain, gain);
+        }
+        report.meanGain /= report.windows.size();
+
+        for (const auto& window : report.windows)
+        {
+            const Amount deviation = window.endTotal - window.startTotal - report.meanGain;
+            report.stddevGain += deviation * deviation;
+        }
+        report.stddevGain = std::sqrt(report.stddevGain / report.windows.size());
+        return report;
+    }
+
+private:
+    const FlowTrace& m_trace;
+    const SharedScenario m_scenario;
+    const std::vector<ParamOverride> m_overrides;
+    StrategyFactory m_factory;
+    BatchRunner& m_runner;
+};
+
+/// Gaussian-process regression with a squared exponential kernel, used as a
+/// cheap stand-in for full simulations. Inputs are expected scaled to [0, 1],
+/// targets are standardised internally and the length scale is picked from
+/// a small grid by marginal likelihood on each fit.
+class GaussianProcess
+{
+public:
+    // Leaves the process unfitted when no length scale factorises, even
+    // with the largest jitter
+    void fit(const std::vector<std::vector<double>>& x, const std::vector<double>& y)
+    {
+        m_x = x;
+        m_chol.clear();
+        m_alpha.clear();
+        const size_t n = x.size();
+        m_mean = 0.;
+        for (double v : y)
+        {
+            m_mean += v;
+        }
+        m_mean /= std::max<size_t>(n, 1);
+
+        m_scale = 0.;
+        for (double v : y)
+        {
+            m_scale += (v - m_mean) * (v - m_mean);
+        }
+        m_scale = n > 1 ? std::sqrt(m_scale / (n - 1)) : 1.;
+        m_scale = m_scale > 0. ? m_scale : 1.;
+
+        std::vector<double> target(n);
+        for (size_t i{ 0 }; i < n; ++i)
+        {
+            target[i] = (y[i] - m_mean) / m_scale;
+        }
+
+        const double dims = x.empty() ? 1. : static_cast<double>(x.front().size());
+        double bestLikelihood = -std::numeric_limits<double>::infinity();
+        for (double jitter : { 1e-6, 1e-4, 1e-2 })
+        {
+            m_jitter = jitter;
+            for (double lengthScale : { 0.05, 0.1, 0.2, 0.4, 0.8 })
+            {
+                m_lengthScale = lengthScale * std::sqrt(dims);
+                tryLengthScale(target, bestLikelihood);
+            }
+            if (fitted())
+            {
+                break;
+            }
+        }
+        m_lengthScale = m_bestLengthScale;
+    }
+
+    bool fitted() const { return !m_alpha.empty(); }
+
+    // Predictive mean and standard deviation in target units, the prior
+    // ones while unfitted
+    std::pair<double, double> predict(const std::vector<double>& x) const
+    {
+        if (!fitted())
+        {
+            return { m_mean, m_scale };
+        }
+
+        const size_t n = m_x.size();
+        std::vector<double> k(n);
+        double mean{ 0. };
+        for (size_t i{ 0 }; i < n; ++i)
+        {
+            k[i] = kernel(x, m_x[i]);
+            mean += k[i] * m_alpha[i];
+        }
+
+        // v = L^-1 k, variance = k(x, x) - v.v
+        double variance = 1.;
+        for (size_t i{ 0 }; i < n; ++i)
+        {
+            double v = k[i];
+            for (size_t j{ 0 }; j < i; ++j)
+            {
+                v -= m_chol[i * n + j] * k[j];
+            }
+            k[i] = v / m_chol[i * n + i];
+            variance -= k[i] * k[i];
+        }
+
+        return { m_mean + mean * m_scale, std::sqrt(std::max(variance, 0.)) * m_scale };
+    }
+
+private:
+    // Keeps the factors when the current length scale fits better than bestLikelihood
+    void tryLengthScale(const std::vector<double>& target, double& bestLikelihood)
+    {
+        const size_t n = target.size();
+        std::vector<double> chol;
+        std::vector<double> alpha;
+        if (!factorise(target, chol, alpha))
+        {
+            return;
+        }
+
+        double likelihood{ 0. };
+        for (size_t i{ 0 }; i < n; ++i)
+        {
+            likelihood -= 0.5 * target[i] * alpha[i] + std::log(chol[i * n + i]);
+        }
+
+        if (likelihood > bestLikelihood)
+        {
+            bestLikelihood = likelihood;
+            m_bestLengthScale = m_lengthScale;
+            m_chol.swap(chol);
+            m_alpha.swap(alpha);
+        }
+    }
+
+    double kernel(const std::vector<double>& a, const std::vector<double>& b) const
+    {
+        double distance{ 0. };
+        for (size_t d{ 0 }; d < a.size(); ++d)
+        {
+            distance += (a[d] - b[d]) * (a[d] - b[d]);
+        }
+        return std::exp(-0.5 * distance / (m_lengthScale * m_lengthScale));
+    }
+
+    // Cholesky factor of K + noise and alpha = K^-1 y
+    bool factorise(const std::vector<double>& y, std::vector<double>& chol, std::vector<double>& alpha) const
+    {
+        const size_t n = m_x.size();
+        chol.assign(n * n, 0.);
+        for (size_t i{ 0 }; i < n; ++i)
+        {
+            for (size_t j{ 0 }; j <= i; ++j)
+            {
+                double sum = kernel(m_x[i], m_x[j]) + (i == j ? m_jitter : 0.);
+                for (size_t k{ 0 }; k < j; ++k)
+                {
+                    sum -= chol[i * n + k] * chol[j * n + k];
+                }
+
+                if (i == j)
+                {
+                    if (sum <= 0.)
+                    {
+                        return false;
+                    }
+                    chol[i * n + i] = std::sqrt(sum);
+                }
+                else
+                {
+                    chol[i * n + j] = sum / chol[j * n + j];
+                }
+            }
+        }
+
+        alpha = y;
+        for (size_t i{ 0 }; i < n; ++i)
+        {
+            for (size_t k{ 0 }; k < i; ++k)
+            {
+                alpha[i] -= chol[i * n + k] * alpha[k];
+            }
+            alpha[i] /= chol[i * n + i];
+        }
+        for (size_t i = n; i-- > 0;)
+        {
+            for (size_t k = i + 1; k < n; ++k)
+            {
+                alpha[i] -= chol[k * n + i] * alpha[k];
+            }
+            alpha[i] /= chol[i * n + i];
+        }
+        return true;
+    }
+
+    std::vector<std::vector<double>> m_x;
+    std::vector<double> m_chol;
+    std::vector<double> m_alpha;
+    double m_mean{ 0. };
+    double m_scale{ 1. };
+    double m_lengthScale{ 1. };
+    double m_bestLengthScale{ 1. };
+    double m_jitter{ 1e-6 };
+};
+
+struct SweepConfig
+{
+    size_t initialSamples{ 16 };    // Simulated before the surrogate is first fitted
+    size_t batchSize{ 8 };          // Simulations between refits
+    double pruneSigma{ 2. };        // Skip candidates whose mean + pruneSigma * sd is below the best total
+    size_t maxTrainingPoints{ 400 };
+    bool useSurrogate{ true };
+};
+
+struct SweepResult
+{
+    std::vector<double> params;
+    Amount total{ 0. };
+    Amount predicted{ 0. };     // Surrogate prediction made before the simulation, if any
+    bool simulated{ false };
+    bool hadPrediction{ false };
+};
+
+struct SweepReport
+{
+    std::vector<SweepResult> results;   // In candidate order
+    size_t best{ 0 };
+    size_t simulated{ 0 };
+    size_t skipped{ 0 };
+    double surrogateMeanAbsError{ 0. };
+    double surrogateRmsError{ 0. };
+};
+
+/// Evaluates a list of parameter candidates, each with a full simulation
+/// run by evaluate(), looking for the highest final total. With the
+/// surrogate enabled a Gaussian process is refitted as results arrive, the
+/// remaining candidates are simulated in order of their upper confidence
+/// bound, and those the surrogate is confident cannot beat the best total
+/// so far are skipped. Predictions made ahead of each simulation are kept
+/// to report the surrogate's validation error.
+class SweepRunner
+{
+public:
+    using Evaluate = std::function<Amount(const std::vector<double>&)>;
+
+    SweepRunner(BatchRunner& runner, Evaluate evaluate)
+        : m_runner(runner)
+        , m_evaluate(std::move(evaluate))
+    { }
+
+    SweepReport run(const std::vector<std::vector<double>>& candidates, const SweepConfig& config)
+    {
+        SweepReport report;
+        report.results.resize(candidates.size());
+        for (size_t i{ 0 }; i < candidates.size(); ++i)
+        {
+            report.results[i].params = candidates[i];
+        }
+        if (candidates.empty())
+        {
+            return report;
+        }
+
+        // Scale every dimension to [0, 1] over the candidate set
+        const size_t dims = candidates.front().size();
+        std::vector<double> low(dims, std::numeric_limits<double>::max());
+        std::vector<double> high(dims, std::numeric_limits<double>::lowest());
+        for (const auto& candidate : candidates)
+        {
+            for (size_t d{ 0 }; d < dims; ++d)
+            {
+                low[d] = std::min(low[d], candidate[d]);
+                high[d] = std::max(high[d], candidate[d]);
+            }
+        }
+        std::vector<std::vector<double>> scaled(candidates.size(), std::vector<double>(dims));
+        for (size_t i{ 0 }; i < candidates.size(); ++i)
+        {
+            for (size_t d{ 0 }; d < dims; ++d)
+            {
+                scaled[i][d] = high[d] > low[d] ? (candidates[i][d] - low[d]) / (high[d] - low[d]) : 0.5;
+            }
+        }
+
+        std::vector<size_t> pending;
+        std::vector<size_t> batch;
+        const size_t initial = config.useSurrogate ? std::min(config.initialSamples, candidates.size()) : candidates.size();
+        for (size_t i{ 0 }; i < candidates.size(); ++i)
+        {
+            // Spread the initial samples evenly over the candidate list
+            const bool first = initial && (i * initial / candidates.size() != (i + 1) * initial / candidates.size());
+            (first ? batch : pending).push_back(i);
+        }
+
+        GaussianProcess surrogate;
+        Amount bestTotal = std::numeric_limits<Amount>::lowest();
+        while (!batch.empty())
+        {
+            m_runner.run(batch.size(), [&](size_t i) {
+                SweepResult& result = report.results[batch[i]];
+                result.total = m_evaluate(result.params);
+                result.simulated = true;
+            });
+
+            for (size_t i : batch)
+            {
+                ++report.simulated;
+                if (report.results[i].total > bestTotal)
+                {
+                    bestTotal = report.results[i].total;
+                    report.best = i;
+                }
+            }
+            batch.clear();
+
+            if (pending.empty())
+            {
+                break;
+            }
+
+            // Refit on the best results when over the training cap, they
+            // matter most for deciding what can be pruned
+            std::vector<size_t> training;
+            for (size_t i{ 0 }; i < report.results.size(); ++i)
+            {
+                if (report.results[i].simulated)
+                {
+                    training.push_back(i);
+                }
+            }
+            if (training.size() > config.maxTrainingPoints)
+            {
+                std::partial_sort(training.begin(), training.begin() + config.maxTrainingPoints, training.end(),
+                    [&](size_t a, size_t b) { return report.results[a].total > report.results[b].total; });
+                training.resize(config.maxTrainingPoints);
+            }
+
+            std::vector<std::vector<double>> x;
+            std::vector<double> y;
+            for (size_t i : training)
+            {
+                x.push_back(scaled[i]);
+                y.push_back(report.results[i].total);
+            }
+            surrogate.fit(x, y);
+            if (!surrogate.fitted())
+            {
+                // Carry on in candidate order without pruning
+                const size_t take = std::min(config.batchSize, pending.size());
+                batch.assign(pending.begin(), pending.begin() + take);
+                pending.erase(pending.begin(), pending.begin() + take);
+                continue;
+            }
+
+            std::vector<std::pair<double, size_t>> ranked;
+            for (size_t i : pending)
+            {
+                const auto [mean, sd] = surrogate.predict(scaled[i]);
+                SweepResult& result = report.results[i];
+                result.predicted = mean;
+                result.hadPrediction = true;
+
+                const double upper = mean + config.pruneSigma * sd;
+                if (upper < bestTotal)
+                {
+                    ++report.skipped;
+                    continue;
+                }
+                ranked.emplace_back(upper, i);
+            }
+
+            std::sort(ranked.begin(), ranked.end(), std::greater<>());
+            pending.clear();
+            for (size_t r{ 0 }; r < ranked.size(); ++r)
+            {
+                (r < config.batchSize ? batch : pending).push_back(ranked[r].second);
+            }
+        }
+
+        size_t validated{ 0 };
+        for (const auto& result : report.results)
+        {
+            if (result.simulated && result.hadPrediction)
+            {
+                const double error = result.predicted - result.total;
+                report.surrogateMeanAbsError += std::abs(error);
+                report.surrogateRmsError += error * error;
+                ++validated;
+            }
+        }
+        if (validated)
+        {
+            report.surrogateMeanAbsError /= validated;
+            report.surrogateRmsError = std::sqrt(report.surrogateRmsError / validated);
+        }
+
+        return report;
+    }
+
+private:
+    BatchRunner& m_runner;
+    Evaluate m_evaluate;
+};
+
+struct ParamRange
+{
+    std::string chain;
+    ParamField field;
+    double low;
+    double high;
+};
+
+struct SobolIndex
+{
+    ParamRange range;
+    double firstOrder{ 0. };
+    double firstOrderLow{ 0. };     // 95% bootstrap interval
+    double firstOrderHigh{ 0. };
+    double total{ 0. };
+    double totalLow{ 0. };
+    double totalHigh{ 0. };
+};
+
+struct SensitivityReport
+{
+    bool valid{ false };            // False when a range names an unknown chain, nothing is run then
+    std::vector<SobolIndex> indices;
+    size_t simulations{ 0 };
+    Amount mean{ 0. };
+    Amount variance{ 0. };
+};
+
+/// Variance-based global sensitivity of the final total to ChainParams
+/// fields. Samples matrices A and B uniformly over the ranges, builds the
+/// Saltelli matrices A_B(i) taking column i from B, and runs the
+/// N * (d + 2) simulations on the batch runner. First-order indices use the
+/// Saltelli (2010) estimator and total indices Jansen's, with intervals from
+/// bootstrap resampling of the sample rows.
+class SensitivityAnalysis
+{
+public:
+    SensitivityAnalysis(BatchRunner& runner, Scenario base, StrategyFactory factory, Ticks iterations)
+        : m_runner(runner)
+        , m_base(shareScenario(std::move(base)))
+        , m_factory(std::move(factory))
+        , m_iterations(iterations)
+    { }
+
+    SensitivityReport run(const std::vector<ParamRange>& ranges, size_t samples, size_t resamples = 200, uint64_t seed = 1)
+    {
+        const size_t d = ranges.size();
+        const size_t n = samples;
+        SensitivityReport report;
+        std::vector<size_t> chainOf(d);
+        for (size_t k{ 0 }; k < d; ++k)
+        {
+            auto it = m_base->index.find(ranges[k].chain);
+            if (it == m_base->index.end())
+            {
+                return report;
+            }
+            chainOf[k] = it->second;
+        }
+        report.valid = true;
+        if (n == 0)
+        {
+            return report;
+        }
+        report.simulations = n * (d + 2);
+
+        std::mt19937_64 rng(seed);
+        std::uniform_real_distribution<double> uniform(0., 1.);
+        std::vector<double> a(n * d);
+        std::vector<double> b(n * d);
+        for (auto& v : a)
+        {
+            v = uniform(rng);
+        }
+        for (auto& v : b)
+        {
+            v = uniform(rng);
+        }
+
+        // Rows 0..n-1 are A, n..2n-1 are B, then n rows for each A_B(i)
+        std::vector<Amount> totals(report.simulations);
+        m_runner.run(report.simulations, [&](size_t job) {
+            const size_t matrix = job / n;
+            const size_t row = job % n;
+            std::vector<ParamOverride> overrides;
+            overrides.reserve(d);
+            for (size_t k{ 0 }; k < d; ++k)
+            {
+                const bool fromB = matrix == 1 || (matrix >= 2 && matrix - 2 == k);
+                const double u = (fromB ? b : a)[row * d + k];
+                const ParamRange& range = ranges[k];
+                overrides.push_back(ParamOverride{ chainOf[k], range.field, range.low + u * (range.high - range.low) });
+            }
+
+            auto strategy = m_factory();
+            Simulation sim(strategy.get(), m_base, overrides);
+            sim.setVerbose(false);
+            sim.advance(m_iterations);
+            totals[job] = sim.total();
+        });
+
+        std::vector<size_t> rows(n);
+        for (size_t i{ 0 }; i < n; ++i)
+        {
+            rows[i] = i;
+        }
+        const Estimate estimate = estimateIndices(totals, rows, n, d);
+        report.mean = estimate.mean;
+        report.variance = estimate.variance;
+
+        std::vector<std::vector<double>> firstOrder(d);
+        std::vector<std::vector<double>> total(d);
+        std::uniform_int_distribution<size_t> pick(0, n - 1);
+        for (size_t r{ 0 }; r < resamples; ++r)
+        {
+            for (auto& row : rows)
+            {
+                row = pick(rng);
+            }
+            const Estimate resampled = estimateIndices(totals, rows, n, d);
+            for (size_t k{ 0 }; k < d; ++k)
+            {
+                firstOrder[k].push_back(resampled.firstOrder[k]);
+                total[k].push_back(resampled.total[k]);
+            }
+        }
+
+        for (size_t k{ 0 }; k < d; ++k)
+        {
+            SobolIndex index{ ranges[k] };
+            index.firstOrder = estimate.firstOrder[k];
+            index.total = estimate.total[k];
+            std::tie(index.firstOrderLow, index.firstOrderHigh) = interval(firstOrder[k]);
+            std::tie(index.totalLow, index.totalHigh) = interval(total[k]);
+            report.indices.push_back(index);
+        }
+        return report;
+    }
+
+private:
+    struct Estimate
+    {
+        double mean{ 0. };
+        double variance{ 0. };
+        std::vector<double> firstOrder;
+        std::vector<double> total;
+    };
+
+    static Estimate estimateIndices(const std::vector<Amount>& totals, const std::vector<size_t>& rows, size_t n, size_t d)
+    {
+        Estimate estimate;
+        for (size_t row : rows)
+        {
+            estimate.mean += totals[row] + totals[n + row];
+        }
+        estimate.mean /= 2. * rows.size();
+        for (size_t row : rows)
+        {
+            estimate.variance += (totals[row] - estimate.mean) * (totals[row] - estimate.mean)
+                + (totals[n + row] - estimate.mean) * (totals[n + row] - estimate.mean);
+        }
+        estimate.variance /= 2. * rows.size() - 1.;
+
+        for (size_t k{ 0 }; k < d; ++k)
+        {
+            double first{ 0. };
+            double total{ 0. };
+            for (size_t row : rows)
+            {
+                // Centring leaves the estimators unbiased and cuts their
+                // variance when the mean is large against the spread
+                const double fA = totals[row] - estimate.mean;
+                const double fB = totals[n + row] - estimate.mean;
+                const double fAB = totals[(k + 2) * n + row] - estimate.mean;
+                first += fB * (fAB - fA);
+                total += (fA - fAB) * (fA - fAB);
+            }
+            const double scale = estimate.variance > 0. ? 1. / (rows.size() * estimate.variance) : 0.;
+            estimate.firstOrder.push_back(first * scale);
+            estimate.total.push_back(0.5 * total * scale);
+        }
+        return estimate;
+    }
+
+    static std::pair<double, double> interval(std::vector<double>& values)
+    {
+        if (values.empty())
+        {
+            return { 0., 0. };
+        }
+        std::sort(values.begin(), values.end());
+        const size_t last = values.size() - 1;
+        return { values[static_cast<size_t>(0.025 * last)], values[static_cast<size_t>(0.975 * last)] };
+    }
+
+    BatchRunner& m_runner;
+    const SharedScenario m_base;
+    StrategyFactory m_factory;
+    const Ticks m_iterations;
+};
+
+enum class SamplingMethod
+{
+    random,
+    sobol,
+    halton
+};
+
+/// Randomized low-discrepancy points in [0, 1)^d, addressable by index so
+/// jobs can generate their own. Sobol points use Joe-Kuo direction numbers
+/// with a random linear matrix scramble and digital shift, which keeps their
+/// net structure; Halton points use random digit permutations per dimension
+/// and digit. Each seed gives an independent randomization, so the spread of
+/// estimates over seeds measures the error (randomized QMC). Dimensions past
+/// the Sobol table fall back to Halton.
+class LowDiscrepancySequence
+{
+public:
+    static constexpr size_t maxSobolDimensions = 21;
+
+    LowDiscrepancySequence(SamplingMethod method, size_t dimensions, uint64_t seed)
+        : m_method(method == SamplingMethod::sobol && dimensions > maxSobolDimensions ? SamplingMethod::halton : method)
+        , m_dimensions(dimensions)
+        , m_seed(seed)
+    {
+        if (m_method == SamplingMethod::sobol)
+        {
+            initSobol();
+        }
+        else if (m_method == SamplingMethod::halton)
+        {
+            initHalton();
+        }
+    }
+
+    SamplingMethod method() const { return m_method; }
+
+    void point(uint64_t index, double* out) const
+    {
+        switch (m_method)
+        {
+        case SamplingMethod::sobol:
+        {
+            // Gray code of the index selects the direction numbers to combine
+            const uint64_t gray = index ^ (index >> 1);
+            for (size_t d{ 0 }; d < m_dimensions; ++d)
+            {
+                uint32_t x = m_shift[d];
+                const uint32_t* v = &m_directions[d * 32];
+                for (uint64_t bits = gray, k = 0; bits && k < 32; bits >>= 1, ++k)
+                {
+                    x ^= (bits & 1) ? v[k] : 0u;
+                }
+                out[d] = (static_cast<double>(x) + 0.5) * 0x1p-32;
+            }
+            break;
+        }
+        case SamplingMethod::halton:
+            for (size_t d{ 0 }; d < m_dimensions; ++d)
+            {
+                const uint32_t base = m_bases[d];
+                const uint16_t* permutations = &m_permutations[m_permutationOffsets[d]];
+                double scale = 1. / base;
+                double x{ 0. };
+                uint64_t rest = index;
+                for (size_t k{ 0 }; k < m_digits[d]; ++k, scale /= base)
+                {
+                    x += permutations[k * base + rest % base] * scale;
+                    rest /= base;
+                }
+                out[d] = x;
+            }
+            break;
+        case SamplingMethod::random:
+            for (size_t d{ 0 }; d < m_dimensions; ++d)
+            {
+                out[d] = counterUniform(m_seed, index * m_dimensions + d);
+            }
+            break;
+        }
+    }
+
+private:
+    // Degree s, polynomial a and initial m_1..m_s of dimensions 2 onwards
+    struct Primitive
+    {
+        uint32_t degree;
+        uint32_t poly;
+        uint32_t m[7];
+    };
+
+    void initSobol()
+    {
+        static const Primitive table[maxSobolDimensions - 1] = {
+            { 1, 0, { 1 } }, { 2, 1, { 1, 3 } }, { 3, 1, { 1, 3, 1 } }, { 3, 2, { 1, 1, 1 } }, { 4, 1, { 1, 1, 3, 3 } },
+            { 4, 4, { 1, 3, 5, 13 } }, { 5, 2, { 1, 1, 5, 5, 17 } }, { 5, 4, { 1, 1, 5, 5, 5 } }, { 5, 7, { 1, 1, 7, 11, 19 } },
+            { 5, 11, { 1, 1, 5, 1, 1 } }, { 5, 13, { 1, 1, 1, 3, 11 } }, { 5, 14, { 1, 3, 5, 5, 31 } },
+            { 6, 1, { 1, 3, 3, 9, 7, 49 } }, { 6, 13, { 1, 1, 1, 15, 21, 21 } }, { 6, 16, { 1, 3, 1, 13, 27, 49 } },
+            { 6, 19, { 1, 1, 1, 15, 7, 5 } }, { 6, 22, { 1, 3, 1, 15, 13, 25 } }, { 6, 25, { 1, 1, 5, 5, 19, 61 } },
+            { 7, 1, { 1, 3, 7, 11, 23, 15, 103 } }, { 7, 4, { 1, 3, 7, 13, 13, 15, 69 } }
+        };
+
+        m_directions.assign(m_dimensions * 32, 0u);
+        m_shift.assign(m_dimensions, 0u);
+        uint64_t counter{ 0 };
+        for (size_t d{ 0 }; d < m_dimensions; ++d)
+        {
+            uint32_t v[32];
+            if (d == 0)
+            {
+                for (uint32_t k{ 0 }; k < 32; ++k)
+                {
+                    v[k] = 1u << (31 - k);
+                }
+            }
+            else
+            {
+                const Primitive& p = table[d - 1];
+                for (uint32_t k{ 0 }; k < 32; ++k)
+                {
+                    if (k < p.degree)
+                    {
+                        v[k] = p.m[k] << (31 - k);
+                        continue;
+                    }
+                    v[k] = v[k - p.degree] ^ (v[k - p.degree] >> p.degree);
+                    for (uint32_t j{ 1 }; j < p.degree; ++j)
+                    {
+                        if ((p.poly >> (p.degree - 1 - j)) & 1)
+                        {
+                            v[k] ^= v[k - j];
+                        }
+                    }
+                }
+            }
+
+            // Output bit r (from the top) mixes input bits 0..r with a
+            // random lower triangular matrix that has a unit diagonal
+            uint32_t rows[32];
+            for (uint32_t r{ 0 }; r < 32; ++r)
+            {
+                const uint32_t diagonal = 1u << (31 - r);
+                const uint32_t above = r ? ~((diagonal << 1) - 1u) : 0u;
+                rows[r] = diagonal | (static_cast<uint32_t>(counterHash(m_seed, counter++)) & above);
+            }
+            for (uint32_t k{ 0 }; k < 32; ++k)
+            {
+                uint32_t scrambled{ 0 };
+                for (uint32_t r{ 0 }; r < 32; ++r)
+                {
+                    scrambled |= static_cast<uint32_t>(parity(rows[r] & v[k])) << (31 - r);
+                }
+                m_directions[d * 32 + k] = scrambled;
+            }
+            m_shift[d] = static_cast<uint32_t>(counterHash(m_seed, counter++));
+        }
+    }
+
+    void initHalton()
+    {
+        m_bases.clear();
+        for (uint32_t candidate{ 2 }; m_bases.size() < m_dimensions; ++candidate)
+        {
+            bool prime = true;
+            for (uint32_t b : m_bases)
+            {
+                if (b * b > candidate)
+                {
+                    break;
+                }
+                prime = prime && candidate % b != 0;
+            }
+            if (prime)
+            {
+                m_bases.push_back(candidate);
+            }
+        }
+
+        // Enough digits to resolve doubles, each with its own permutation
+        uint64_t counter{ 0 };
+        for (size_t d{ 0 }; d < m_dimensions; ++d)
+        {
+            const uint32_t base = m_bases[d];
+            const size_t digits = static_cast<size_t>(std::ceil(53. / std::log2(static_cast<double>(base))));
+            m_digits.push_back(digits);
+            m_permutationOffsets.push_back(m_permutations.size());
+            for (size_t k{ 0 }; k < digits; ++k)
+            {
+                const size_t begin = m_permutations.size();
+                for (uint32_t digit{ 0 }; digit < base; ++digit)
+                {
+                    m_permutations.push_back(static_cast<uint16_t>(digit));
+                }
+                for (uint32_t i = base - 1; i > 0; --i)
+                {
+                    const uint32_t j = static_cast<uint32_t>(counterHash(m_seed, counter++) % (i + 1));
+                    std::swap(m_permutations[begin + i], m_permutations[begin + j]);
+                }
+            }
+        }
+    }
+
+    static uint32_t parity(uint32_t x)
+    {
+        x ^= x >> 16;
+        x ^= x >> 8;
+        x ^= x >> 4;
+        x ^= x >> 2;
+        x ^= x >> 1;
+        return x & 1u;
+    }
+
+    const SamplingMethod m_method;
+    const size_t m_dimensions;
+    const uint64_t m_seed;
+    std::vector<uint32_t> m_directions;
+    std::vector<uint32_t> m_shift;
+    std::vector<uint32_t> m_bases;
+    std::vector<size_t> m_digits;
+    std::vector<size_t> m_permutationOffsets;
+    std::vector<uint16_t> m_permutations;
+};
+
+struct ExpectationConfig
+{
+    SamplingMethod method{ SamplingMethod::sobol };
+    size_t points{ 256 };           // Per replicate, a power of two suits Sobol
+    size_t replicates{ 8 };         // Independent randomizations
+    Ticks iterations{ 1000 };
+    uint64_t seed{ 1 };
+};
+
+struct ExpectationReport
+{
+    bool valid{ false };            // False when a range names an unknown chain, nothing is run then
+    double mean{ 0. };
+    double standardError{ 0. };     // Spread of the replicate means
+    size_t simulations{ 0 };
+    std::vector<double> replicateMeans;
+};
+
+/// Expected final total over ChainParams fields drawn uniformly from their
+/// ranges, estimated by randomized QMC: each replicate averages the
+/// simulations at the points of an independently scrambled sequence. With
+/// flow noise every point also gets its own noise seed.
+class ExpectationEstimator
+{
+public:
+    ExpectationEstimator(BatchRunner& runner, Scenario base, StrategyFactory factory, std::vector<FlowNoise> noise = {})
+        : m_runner(runner)
+        , m_base(shareScenario(std::move(base)))
+        , m_factory(std::move(factory))
+        , m_noise(std::move(noise))
+    { }
+
+    ExpectationReport run(const std::vector<ParamRange>& ranges, const ExpectationConfig& config)
+    {
+        ExpectationReport report;
+        const size_t d = ranges.size();
+        std::vector<size_t> chainOf(d);
+        for (size_t k{ 0 }; k < d; ++k)
+        {
+            auto it = m_base->index.find(ranges[k].chain);
+            if (it == m_base->index.end())
+            {
+                return report;
+            }
+            chainOf[k] = it->second;
+        }
+        report.valid = true;
+
+        std::vector<LowDiscrepancySequence> sequences;
+        for (size_t r{ 0 }; r < config.replicates; ++r)
+        {
+            sequences.emplace_back(config.method, d, counterHash(config.seed, r));
+        }
+        if (!sequences.empty() && sequences.front().method() != config.method)
+        {
+            std::cout << "Sobol points support up to [" << LowDiscrepancySequence::maxSobolDimensions << "] ranges, using Halton" << std::endl;
+        }
+
+        report.simulations = config.replicates * config.points;
+        std::vector<Amount> totals(report.simulations);
+        m_runner.run(report.simulations, [&](size_t job) {
+            const size_t replicate = job / config.points;
+            const size_t index = job % config.points;
+            std::vector<double> u(d);
+            sequences[replicate].point(index, u.data());
+
+            std::vector<ParamOverride> overrides;
+            for (size_t k{ 0 }; k < d; ++k)
+            {
+                overrides.push_back(ParamOverride{ chainOf[k], ranges[k].field, ranges[k].low + u[k] * (ranges[k].high - ranges[k].low) });
+            }
+
+            auto strategy = m_factory();
+            Simulation sim(strategy.get(), m_base, overrides);
+            sim.setVerbose(false);
+            if (!m_noise.empty())
+            {
+                sim.setFlowNoise(m_noise, counterHash(counterHash(config.seed, replicate), index));
+            }
+            sim.advance(config.iterations);
+            totals[job] = sim.total();
+        });
+
+        for (size_t r{ 0 }; r < config.replicates; ++r)
+        {
+            double sum{ 0. };
+            for (size_t i{ 0 }; i < config.points; ++i)
+            {
+                sum += totals[r * config.points + i];
+            }
+            report.replicateMeans.push_back(config.points ? sum / config.points : 0.);
+            report.mean += report.replicateMeans.back();
+        }
+
+        const double replicates = static_cast<double>(std::max<size_t>(config.replicates, 1));
+        report.mean /= replicates;
+        double variance{ 0. };
+        for (double m : report.replicateMeans)
+        {
+            variance += (m - report.mean) * (m - report.mean);
+        }
+        report.standardError = std::sqrt(variance / std::max(replicates - 1., 1.) / replicates);
+        return report;
+    }
+
+private:
+    BatchRunner& m_runner;
+    const SharedScenario m_base;
+    StrategyFactory m_factory;
+    const std::vector<FlowNoise> m_noise;
+};
+
+struct AdversarialConfig
+{
+    size_t initialPoints{ 64 };     // Sobol points spread over the ranges
+    size_t rounds{ 20 };
+    size_t batch{ 32 };             // Candidates per round
+    size_t elite{ 4 };              // Worst scenarios so far, perturbed each round
+    double step{ 0.25 };            // Initial perturbation, as a fraction of each range
+    double shrink{ 0.6 };           // Step factor after a round finding nothing worse
+    double minStep{ 0.005 };        // The search ends once the step falls below it
+    size_t replications{ 1 };       // Noise seeds per candidate, the same for every candidate
+    size_t validation{ 16 };        // Fresh noise seeds the worst 2 * keep are re-run on before ranking
+    size_t keep{ 5 };               // Worst scenarios reported
+    Ticks iterations{ 1000 };
+    std::string outputPrefix;       // Writes <prefix>-<rank>.txt, empty for no files
+    uint64_t seed{ 1 };
+};
+
+struct AdversarialScenario
+{
+    std::vector<double> values;     // Per range
+    Amount total{ 0. };             // Mean over the validation seeds, or the search seeds without noise
+    Amount searchTotal{ 0. };       // Mean over the search seeds
+    std::string path;               // Scenario file written, if any
+};
+
+struct AdversarialReport
+{
+    bool valid{ false };                        // False when a range names an unknown chain, nothing is run then
+    std::vector<AdversarialScenario> worst;     // Lowest total first
+    Amount baseTotal{ 0. };                     // Over the validation seeds with noise
+    size_t simulations{ 0 };
+    size_t rounds{ 0 };
+};
+
+/// Searches ChainParams fields within their ranges for the scenarios in
+/// which a strategy ends with the lowest total. Sobol points cover the
+/// ranges first, then each round perturbs the worst scenarios found so far
+/// with Gaussian steps clamped to the ranges, shrinking the step whenever a
+/// round finds nothing worse. A round's candidates run in parallel on the
+/// batch runner. With flow noise every candidate runs on the same seeds, so
+/// candidates are compared on common random numbers. The search favours
+/// scenarios which are bad on those seeds in particular, so the worst
+/// 2 * keep are re-run on fresh seeds and ranked on those totals. The worst
+/// scenarios are written as scenario files which loadScenario reads back.
+class AdversarialSearch
+{
+public:
+    AdversarialSearch(BatchRunner& runner, Scenario base, StrategyFactory factory, std::vector<FlowNoise> noise = {})
+        : m_runner(runner)
+        , m_base(shareScenario(std::move(base)))
+        , m_factory(std::move(factory))
+        , m_noise(std::move(noise))
+    { }
+
+    AdversarialReport run(const std::vector<ParamRange>& ranges, const AdversarialConfig& config)
+    {
+        AdversarialReport report;
+        const size_t d = ranges.size();
+        std::vector<size_t> chainOf(d);
+        for (size_t k{ 0 }; k < d; ++k)
+        {
+            auto it = m_base->index.find(ranges[k].chain);
+            if (it == m_base->index.end())
+            {
+                return report;
+            }
+            chainOf[k] = it->second;
+        }
+        report.valid = true;
+
+        const size_t searchReplications = m_noise.empty() ? 1 : std::max<size_t>(config.replications, 1);
+        const size_t validationReplications = m_noise.empty() ? 0 : config.validation;
+        std::vector<AdversarialScenario> evaluated;
+
+        // Every candidate of a batch runs on each of the replications noise
+        // seeds of the stream, the base scenario being the one without values
+        auto evaluate = [&](const std::vector<std::vector<double>>& candidates, size_t replications, uint64_t stream) {
+            std::vector<Amount> totals(candidates.size() * replications);
+            m_runner.run(totals.size(), [&](size_t job) {
+                const std::vector<double>& values = candidates[job / replications];
+                std::vector<ParamOverride> overrides;
+                for (size_t k{ 0 }; k < values.size(); ++k)
+                {
+                    overrides.push_back(ParamOverride{ chainOf[k], ranges[k].field, values[k] });
+                }
+
+                auto strategy = m_factory();
+                Simulation sim(strategy.get(), m_base, overrides);
+                sim.setVerbose(false);
+                if (!m_noise.empty())
+                {
+                    sim.setFlowNoise(m_noise, counterHash(config.seed ^ stream, job % replications));
+                }
+                sim.advance(config.iterations);
+                totals[job] = sim.total();
+            });
+            report.simulations += totals.size();
+
+            std::vector<Amount> means(candidates.size(), 0.);
+            for (size_t job{ 0 }; job < totals.size(); ++job)
+            {
+                means[job / replications] += totals[job] / replications;
+            }
+            return means;
+        };
+
+        const uint64_t searchStream{ 0xAD7Eull };
+        const uint64_t validationStream{ 0x7A11Dull };
+        report.baseTotal = evaluate({ {} }, searchReplications, searchStream).front();
+
+        std::vector<std::vector<double>> candidates;
+        LowDiscrepancySequence sequence(SamplingMethod::sobol, d, config.seed);
+        std::vector<double> u(d);
+        for (size_t i{ 0 }; i < config.initialPoints; ++i)
+        {
+            sequence.point(i, u.data());
+            for (size_t k{ 0 }; k < d; ++k)
+            {
+                u[k] = ranges[k].low + u[k] * (ranges[k].high - ranges[k].low);
+            }
+            candidates.push_back(u);
+        }
+        if (candidates.empty() && d > 0)
+        {
+            for (size_t k{ 0 }; k < d; ++k)
+            {
+                u[k] = (ranges[k].low + ranges[k].high) / 2.;
+            }
+            candidates.push_back(u);
+        }
+
+        double step = config.step;
+        uint64_t draw{ 0 };
+        for (size_t round{ 0 }; !candidates.empty(); ++round)
+        {
+            const std::vector<Amount> totals = evaluate(candidates, searchReplications, searchStream);
+            const Amount worstBefore = evaluated.empty() ? std::numeric_limits<Amount>::infinity() : evaluated.front().total;
+            for (size_t i{ 0 }; i < candidates.size(); ++i)
+            {
+                evaluated.push_back(AdversarialScenario{ std::move(candidates[i]), totals[i], totals[i], {} });
+            }
+            std::stable_sort(evaluated.begin(), evaluated.end(),
+                [](const AdversarialScenario& a, const AdversarialScenario& b) { return a.total < b.total; });
+
+            if (round > 0 && !(evaluated.front().total < worstBefore))
+            {
+                step *= config.shrink;
+            }
+            candidates.clear();
+            if (round >= config.rounds || step < config.minStep || d == 0)
+            {
+                break;
+            }
+            report.rounds = round + 1;
+
+            const size_t elite = std::max<size_t>(1, std::min(config.elite, evaluated.size()));
+            for (size_t c{ 0 }; c < config.batch; ++c)
+            {
+                std::vector<double> values = evaluated[c % elite].values;
+                for (size_t k{ 0 }; k < d; ++k)
+                {
+                    const double width = ranges[k].high - ranges[k].low;
+                    values[k] += step * width * counterNormal(config.seed, draw++);
+                    values[k] = std::min(std::max(values[k], std::min(ranges[k].low, ranges[k].high)), std::max(ranges[k].low, ranges[k].high));
+                }
+                candidates.push_back(std::move(values));
+            }
+        }
+
+        std::vector<AdversarialScenario> shortlist;
+        const size_t shortlistSize = validationReplications > 0 ? 2 * config.keep : config.keep;
+        for (const auto& candidate : evaluated)
+        {
+            if (shortlist.size() >= shortlistSize)
+            {
+                break;
+            }
+            if (shortlist.empty() || candidate.values != shortlist.back().values)
+            {
+                shortlist.push_back(candidate);
+            }
+        }
+
+        if (validationReplications > 0)
+        {
+            std::vector<std::vector<double>> values{ {} };
+            for (const auto& candidate : shortlist)
+            {
+                values.push_back(candidate.values);
+            }
+            const std::vector<Amount> totals = evaluate(values, validationReplications, validationStream);
+            report.baseTotal = totals.front();
+            for (size_t i{ 0 }; i < shortlist.size(); ++i)
+            {
+                shortlist[i].total = totals[i + 1];
+            }
+            std::stable_sort(shortlist.begin(), shortlist.end(),
+                [](const AdversarialScenario& a, const AdversarialScenario& b) { return a.total < b.total; });
+        }
+
+        for (const auto& candidate : shortlist)
+        {
+            if (report.worst.size() >= config.keep)
+            {
+                break;
+            }
+
+            report.worst.push_back(candidate);
+            if (!config.outputPrefix.empty())
+            {
+                Scenario scenario = m_base->chains;
+                for (size_t k{ 0 }; k < d; ++k)
+                {
+                    setField(scenario, ranges[k].chain, ranges[k].field, candidate.values[k]);
+                }
+                const std::string path = config.outputPrefix + "-" + std::to_string(report.worst.size()) + ".txt";
+                if (saveScenario(scenario, path))
+                {
+                    report.worst.back().path = path;
+                }
+            }
+        }
+        return report;
+    }
+
+private:
+    BatchRunner& m_runner;
+    const SharedScenario m_base;
+    StrategyFactory m_factory;
+    const std::vector<FlowNoise> m_noise;
+};
+
+struct SequentialConfig
+{
+    double alpha{ 0.05 };           // Error probability over the whole sequence
+    Amount margin{ 0. };            // Differences within it count as equivalent, 0 to require a winner
+    size_t minReplications{ 20 };   // Before the variance estimate is trusted
+    size_t maxReplications{ 10000 };
+    size_t batch{ 0 };              // Replications scheduled per round, 0 for twice the threads
+    size_t plannedReplications{ 500 };  // Where the confidence sequence is tightest
+    Ticks iterations{ 1000 };
+    uint64_t seed{ 1 };
+};
+
+enum class ComparisonDecision
+{
+    unresolved,
+    aBetter,
+    bBetter,
+    equivalent
+};
+
+struct SequentialReport
+{
+    bool valid{ false };            // False when a range names an unknown chain, nothing is run then
+    ComparisonDecision decision{ ComparisonDecision::unresolved };
+    size_t replications{ 0 };       // Used for the decision
+    size_t simulations{ 0 };        // Run, including the rest of the last round
+    size_t replicationsSaved{ 0 };  // Against running maxReplications
+    double meanDifference{ 0. };    // Strategy A minus strategy B
+    double lower{ 0. };
+    double upper{ 0. };
+};
+
+/// Compares two strategies on paired replications until the difference in
+/// final totals is resolved. Both strategies of a replication see the same
+/// flow noise and ChainParams draws, and after each replication an
+/// asymptotic confidence sequence (Waudby-Smith et al.) on the mean
+/// difference is checked. It holds at every replication count at once, so
+/// stopping as soon as it excludes zero, or falls within the margin, keeps
+/// the error probability at alpha. Replications run in rounds on the batch
+/// runner and are consumed in order, so the result does not depend on the
+/// number of threads.
+class SequentialComparison
+{
+public:
+    SequentialComparison(BatchRunner& runner, Scenario scenario, std::vector<FlowNoise> noise, std::vector<ParamRange> ranges = {})
+        : m_runner(runner)
+        , m_scenario(shareScenario(std::move(scenario)))
+        , m_noise(std::move(noise))
+        , m_ranges(std::move(ranges))
+    {
+        for (const auto& range : m_ranges)
+        {
+            auto it = m_scenario->index.find(range.chain);
+            m_chainOf.push_back(it == m_scenario->index.end() ? m_scenario->chains.size() : it->second);
+        }
+    }
+
+    SequentialReport run(const StrategyFactory& a, const StrategyFactory& b, const SequentialConfig& config)
+    {
+        SequentialReport report;
+        for (size_t chain : m_chainOf)
+        {
+            if (chain == m_scenario->chains.size())
+            {
+                return report;
+            }
+        }
+        report.valid = true;
+        const size_t batch = config.batch ? config.batch : 2 * m_runner.threads();
+
+        // Mixture parameter of the boundary, tuned for the planned count
+        const double logAlpha = std::log(config.alpha);
+        const double rho2 = (-2. * logAlpha + std::log(-2. * logAlpha + 1.)) / std::max<double>(static_cast<double>(config.plannedReplications), 1.);
+
+        double mean{ 0. };
+        double m2{ 0. };
+        size_t n{ 0 };
+        std::vector<Amount> totals;
+        while (n < config.maxReplications && report.decision == ComparisonDecision::unresolved)
+        {
+            const size_t first = n;
+            const size_t count = std::min(batch, config.maxReplications - first);
+            // Even jobs run strategy A, odd ones B on the same replication
+            totals.assign(2 * count, 0.);
+            m_runner.run(2 * count, [&](size_t job) { totals[job] = replicate(job % 2 ? b : a, first + job / 2, config); });
+            report.simulations += 2 * count;
+
+            for (size_t i{ 0 }; i < count && report.decision == ComparisonDecision::unresolved; ++i)
+            {
+                ++n;
+                const double difference = totals[2 * i] - totals[2 * i + 1];
+                const double delta = difference - mean;
+                mean += delta / n;
+                m2 += delta * (difference - mean);
+                if (n < std::max<size_t>(config.minReplications, 2))
+                {
+                    continue;
+                }
+
+                // Normal-mixture boundary on the standardized sum
+                const double t = static_cast<double>(n);
+                const double deviation = std::sqrt(m2 / (t - 1.));
+                const double radius = deviation * std::sqrt(2. * (t * rho2 + 1.) / (t * t * rho2) * std::log(std::sqrt(t * rho2 + 1.) / config.alpha));
+                report.lower = mean - radius;
+                report.upper = mean + radius;
+                report.decision = decide(report.lower, report.upper, config.margin);
+            }
+        }
+
+        report.replications = n;
+        report.meanDifference = mean;
+        report.replicationsSaved = config.maxReplications - n;
+        return report;
+    }
+
+private:
+    Amount replicate(const StrategyFactory& factory, size_t replication, const SequentialConfig& config) const
+    {
+        std::vector<ParamOverride> overrides;
+        for (size_t k{ 0 }; k < m_ranges.size(); ++k)
+        {
+            const double u = counterUniform(counterHash(config.seed, replication), k);
+            overrides.push_back(ParamOverride{ m_chainOf[k], m_ranges[k].field, m_ranges[k].low + u * (m_ranges[k].high - m_ranges[k].low) });
+        }
+
+        auto strategy = factory();
+        Simulation sim(strategy.get(), m_scenario, overrides);
+        sim.setVerbose(false);
+        if (!m_noise.empty())
+        {
+            sim.setFlowNoise(m_noise, counterHash(config.seed ^ 0x5EC0ull, replication));
+        }
+        sim.advance(config.iterations);
+        return sim.total();
+    }
+
+    static ComparisonDecision decide(double lower, double upper, Amount margin)
+    {
+        if (margin > 0. && lower > -margin && upper < margin)
+        {
+            return ComparisonDecision::equivalent;
+        }
+        if (lower > 0.)
+        {
+            return ComparisonDecision::aBetter;
+        }
+        if (upper < 0.)
+        {
+            return ComparisonDecision::bBetter;
+        }
+        return ComparisonDecision::unresolved;
+    }
+
+    BatchRunner& m_runner;
+    const SharedScenario m_scenario;
+    const std::vector<FlowNoise> m_noise;
+    const std::vector<ParamRange> m_ranges;
+    std::vector<size_t> m_chainOf;  // Scenario index of each range, chains.size() when unknown
+};
+
+struct SplittingConfig
+{
+    Ticks horizon{ 1000 };
+    Amount loss{ 0. };              // The event is a final total below the starting total minus loss
+    std::vector<Amount> levels;     // Increasing shortfalls of the total against the noise-free run
+    unsigned split{ 4 };            // Clones made of a trajectory crossing a level
+    size_t roots{ 1000 };
+    uint64_t seed{ 1 };
+};
+
+struct SplittingReport
+{
+    double probability{ 0. };
+    double standardError{ 0. };
+    uint64_t events{ 0 };           // Trajectories ending in the event
+    uint64_t ticks{ 0 };            // Ticks simulated over all trajectories
+    double plainTicks{ 0. };        // Ticks plain Monte Carlo needs for the same relative error
+    std::vector<uint64_t> levelHits;
+};
+
+/// Probability of a tail loss under flow noise by multilevel splitting
+/// (fixed splitting, RESTART style). Levels are on the shortfall of the
+/// total against the same strategy's noise-free run at the same tick, so
+/// they measure how far a trajectory has drifted towards a loss whatever
+/// the typical path looks like. Each root trajectory runs until its
+/// shortfall crosses the next level, is then cloned into `split` copies
+/// continuing on fresh noise streams, and so on until the horizon. An
+/// event reached through k splits counts 1 / split^k, so the mean over
+/// independent roots is unbiased and its spread gives the error. Clones
+/// share the strategy object and are rewound by restoring the chains, so
+/// strategies must decide from the chains they are given.
+class SplittingEstimator
+{
+public:
+    SplittingEstimator(BatchRunner& runner, Scenario scenario, std::vector<FlowNoise> noise, StrategyFactory factory)
+        : m_runner(runner)
+        , m_scenario(shareScenario(std::move(scenario)))
+        , m_noise(std::move(noise))
+        , m_factory(std::move(factory))
+    { }
+
+    SplittingReport run(const SplittingConfig& config)
+    {
+        std::vector<Amount> reference(config.horizon + 1);
+        {
+            auto strategy = m_factory();
+            Simulation sim(strategy.get(), m_scenario);
+            sim.setVerbose(false);
+            reference[0] = sim.total();
+            for (Ticks t{ 1 }; t <= config.horizon; ++t)
+            {
+                sim.advance(1);
+                reference[t] = sim.total();
+            }
+        }
+
+        std::vector<Root> roots(config.roots);
+        m_runner.run(roots.size(), [&](size_t i) {
+            Root& root = roots[i];
+            root.levelHits.assign(config.levels.size(), 0);
+
+            auto strategy = m_factory();
+            Simulation sim(strategy.get(), m_scenario);
+            sim.setVerbose(false);
+            const uint64_t seed = counterHash(config.seed, i);
+            sim.setFlowNoise(m_noise, seed);
+            root.weight = follow(sim, config, reference, 0, seed, root);
+        });
+
+        SplittingReport report;
+        report.levelHits.assign(config.levels.size(), 0);
+        for (const auto& root : roots)
+        {
+            report.probability += root.weight;
+            report.events += root.events;
+            report.ticks += root.ticks;
+            for (size_t l{ 0 }; l < root.levelHits.size(); ++l)
+            {
+                report.levelHits[l] += root.levelHits[l];
+            }
+        }
+
+        const double n = static_cast<double>(std::max<size_t>(roots.size(), 1));
+        report.probability /= n;
+        double variance{ 0. };
+        for (const auto& root : roots)
+        {
+            variance += (root.weight - report.probability) * (root.weight - report.probability);
+        }
+        variance /= std::max(n - 1., 1.);
+        report.standardError = std::sqrt(variance / n);
+
+        // Plain Monte Carlo reaches a relative error e with (1 - p) / (p e^2) runs
+        if (report.probability > 0. && report.standardError > 0.)
+        {
+            const double relative = report.standardError / report.probability;
+            report.plainTicks = (1. - report.probability) / (report.probability * relative * relative) * config.horizon;
+        }
+        return report;
+    }
+
+private:
+    struct Root
+    {
+        double weight{ 0. };
+        uint64_t events{ 0 };
+        uint64_t ticks{ 0 };
+        std::vector<uint64_t> levelHits;
+    };
+
+    // Weighted event count of the trajectory continuing from the
+    // simulation's current state
+    static double follow(Simulation& sim, const SplittingConfig& config, const std::vector<Amount>& reference, size_t level,
+        uint64_t seed, Root& root)
+    {
+        while (sim.currentTick() < config.horizon)
+        {
+            sim.advance(1);
+            ++root.ticks;
+
+            if (level < config.levels.size() && reference[sim.currentTick()] - sim.total() >= config.levels[level])
+            {
+                ++root.levelHits[level];
+                const SimulationState state = sim.checkpoint();
+                const unsigned split = std::max(config.split, 1u);
+                double weight{ 0. };
+                for (unsigned k{ 0 }; k < split; ++k)
+                {
+                    if (k)
+                    {
+                        sim.restore(state);
+                    }
+                    const uint64_t cloneSeed = counterHash(seed, k);
+                    sim.reseedFlowNoise(cloneSeed);
+                    weight += follow(sim, config, reference, level + 1, cloneSeed, root);
+                }
+                return weight / split;
+            }
+        }
+
+        const bool event = sim.total() < reference[0] - config.loss;
+        root.events += event;
+        return event ? 1. : 0.;
+    }
+
+    BatchRunner& m_runner;
+    const SharedScenario m_scenario;
+    const std::vector<FlowNoise> m_noise;
+    StrategyFactory m_factory;
+};
+
+/// Coarse engine for screening: pools, balances and in-flight amounts are
+/// advanced in steps of many ticks as a continuous flow. The strategy is
+/// called once per step through the same IStrategy interface, seeing pools
+/// after one tick of regen, and each action it returns is taken as a rate
+/// flowing for the step, as far as the source balance and the destination
+/// pool plus its regen over the step allow. As in the exact engine an
+/// action is rejected when not even one whole action fits, so a step of one
+/// tick reproduces the exact engine. Amounts locked during a step land
+/// spread over the step after their lock time, and capital landing within
+/// the step can be spent again in it. Only the native asset is modelled.
+class FluidSimulation
+{
+public:
+    FluidSimulation(IStrategy* strategy, SharedScenario scenario, Ticks step, const std::vector<ParamOverride>& overrides = {})
+        : m_strategy(strategy)
+        , m_scenario(std::move(scenario))
+        , m_step(std::max<Ticks>(step, 1))
+    {
+        m_chains = buildChains(*m_scenario, overrides, m_overriddenParams);
+    }
+
+    const Chains& chains() const { return m_chains; }
+    Ticks currentTick() const { return m_tick; }
+
+    void advance(Ticks ticks)
+    {
+        for (Ticks done{ 0 }; done < ticks;)
+        {
+            const Ticks h = std::min(m_step, ticks - done);
+            step(h);
+            done += h;
+            m_tick += h;
+        }
+    }
+
+    Amount total() const
+    {
+        Amount total{ 0. };
+        for (const auto& chain : m_chains)
+        {
+            total += chain.balance;
+            for (const auto& locked : chain.lockedBalances)
+            {
+                total += locked.first;
+            }
+        }
+        return total;
+    }
+
+private:
+    void step(Ticks h)
+    {
+        const Amount dt = static_cast<Amount>(h);
+        const size_t n = m_chains.size();
+        m_orderflowAvailable.resize(n);
+        m_outflowAvailable.resize(n);
+
+        for (size_t i{ 0 }; i < n; ++i)
+        {
+            Chain& chain = m_chains[i];
+            auto& locked = chain.lockedBalances;
+            for (size_t k{ 0 }; k < locked.size();)
+            {
+                if (locked[k].second <= h)
+                {
+                    chain.balance += locked[k].first;
+                    locked[k] = locked.back();
+                    locked.pop_back();
+                    continue;
+                }
+                locked[k].second -= h;
+                ++k;
+            }
+
+            // The first tick's regen is capped as in the exact engine, the
+            // rest of the step's refills space freed by the actions
+            chain.currentOrderflowBal = std::min(chain.currentOrderflowBal + chain.params().orderflowRegenPerTick, chain.maxOrderflowBal);
+            chain.currentOutflowBal = std::min(chain.currentOutflowBal + chain.params().outflowRegenPerTick, chain.maxOutflowBal);
+            m_orderflowAvailable[i] = chain.currentOrderflowBal + (dt - 1.) * chain.params().orderflowRegenPerTick;
+            m_outflowAvailable[i] = chain.currentOutflowBal + (dt - 1.) * chain.params().outflowRegenPerTick;
+        }
+
+        Actions actions;
+        m_strategy->onTickRecalc(m_chains, actions);
+        resolve(actions, h);
+
+        // Repeats of each action for the step. Capital returned within the
+        // step by its own actions can be spent again, so the repeats are
+        // grown until they stop changing.
+        m_repeats.assign(m_flows.size(), 0.);
+        for (int iteration{ 0 }; iteration < 16; ++iteration)
+        {
+            if (!allocate(dt))
+            {
+                break;
+            }
+        }
+
+        for (size_t j{ 0 }; j < m_flows.size(); ++j)
+        {
+            const Flow& flow = m_flows[j];
+            const Amount amount = flow.amount * m_repeats[j];
+            if (amount <= 0.)
+            {
+                continue;
+            }
+
+            Chain& source = m_chains[flow.source];
+            Chain& destination = m_chains[flow.destination];
+            source.balance -= amount;
+            (flow.bridge ? m_outflowAvailable : m_orderflowAvailable)[flow.destination] -= amount;
+            if (flow.bridge)
+            {
+                m_outflowAvailable[flow.source] += amount;
+            }
+
+            const Amount credited = flow.credit * m_repeats[j];
+            destination.balance += credited * flow.landed;
+            if (flow.landed < 1.)
+            {
+                destination.lockedBalances.push_back({ credited * (1. - flow.landed), flow.remaining });
+            }
+        }
+
+        for (size_t i{ 0 }; i < n; ++i)
+        {
+            m_chains[i].currentOrderflowBal = std::min(m_orderflowAvailable[i], m_chains[i].maxOrderflowBal);
+            m_chains[i].currentOutflowBal = std::min(m_outflowAvailable[i], m_chains[i].maxOutflowBal);
+        }
+    }
+
+    // An action taken as a per-tick flow for the step
+    struct Flow
+    {
+        size_t source;
+        size_t destination;
+        bool bridge;
+        Amount amount;      // Per repeat
+        Amount credit;      // Locked on the destination per repeat
+        Amount landed;      // Share of the credit landing within the step
+        Ticks remaining;    // Lock left on the rest at the next step
+    };
+
+    void resolve(const Actions& actions, Ticks h)
+    {
+        m_flows.clear();
+        for (const auto& action : actions)
+        {
+            auto sourceIt = m_scenario->index.find(action.source);
+            auto destinationIt = m_scenario->index.find(action.destination);
+            if (sourceIt == m_scenario->index.end() || destinationIt == m_scenario->index.end() || sourceIt == destinationIt
+                || action.sourceAsset != 0 || action.destinationAsset != 0 || !(action.amount > 0.))
+            {
+                continue;
+            }
+
+            const ChainParams& params = m_chains[sourceIt->second].params();
+            if (action.amount < params.gasCost)
+            {
+                continue;
+            }
+
+            // Flows spread evenly over [0, h) land over [T, T + h), the
+            // rest is centred on what is left of that window
+            const bool bridge = action.type == Action::type::bridge;
+            const Ticks lockTime = bridge ? params.bridgingTime : params.inventoryLockTime;
+            const Amount landed = lockTime < h ? static_cast<Amount>(h - lockTime) / h : 0.;
+            const Ticks remaining = std::max<Ticks>(std::max<Ticks>(lockTime > h / 2 ? lockTime - h / 2 : 0, (lockTime + 1) / 2), 1);
+            const Amount credit = bridge ? action.amount - params.gasCost : (action.amount - params.gasCost) * params.executionSurplus;
+            m_flows.push_back(Flow{ sourceIt->second, destinationIt->second, bridge, action.amount, credit, landed, remaining });
+        }
+    }
+
+    // One pass handing out repeats in action order against balances
+    // that include the in-step returns of the current repeats, returns
+    // whether any changed
+    bool allocate(Amount dt)
+    {
+        const size_t n = m_chains.size();
+        m_balanceAvailable.resize(n);
+        m_orderflowLeft = m_orderflowAvailable;
+        m_outflowLeft = m_outflowAvailable;
+        for (size_t i{ 0 }; i < n; ++i)
+        {
+            m_balanceAvailable[i] = m_chains[i].balance;
+        }
+        for (size_t j{ 0 }; j < m_flows.size(); ++j)
+        {
+            m_balanceAvailable[m_flows[j].destination] += m_flows[j].credit * m_flows[j].landed * m_repeats[j];
+        }
+
+        bool changed{ false };
+        for (size_t j{ 0 }; j < m_flows.size(); ++j)
+        {
+            const Flow& flow = m_flows[j];
+            Amount& pool = (flow.bridge ? m_outflowLeft : m_orderflowLeft)[flow.destination];
+            const Amount limit = std::min({ dt, m_balanceAvailable[flow.source] / flow.amount, pool / flow.amount });
+            const Amount repeats = limit >= 1. ? limit : 0.;
+            m_balanceAvailable[flow.source] -= flow.amount * repeats;
+            pool -= flow.amount * repeats;
+            if (flow.bridge)
+            {
+                m_outflowLeft[flow.source] += flow.amount * repeats;
+            }
+            changed = changed || repeats != m_repeats[j];
+            m_repeats[j] = repeats;
+        }
+        return changed;
+    }
+
+    IStrategy* m_strategy;
+    const SharedScenario m_scenario;
+    const Ticks m_step;
+    std::deque<ChainParams> m_overriddenParams;
+    Chains m_chains;
+    Ticks m_tick{ 0 };
+    std::vector<Amount> m_orderflowAvailable;
+    std::vector<Amount> m_outflowAvailable;
+    std::vector<Flow> m_flows;
+    std::vector<Amount> m_repeats;
+    std::vector<Amount> m_balanceAvailable;
+    std::vector<Amount> m_orderflowLeft;
+    std::vector<Amount> m_outflowLeft;
+};
+
+/// Agreement of the fluid engine with the exact simulation over a sample of
+/// candidates. The linear fit maps fluid totals onto exact ones, and its
+/// residual spread is the margin used when screening.
+struct FidelityReport
+{
+    size_t samples{ 0 };
+    double meanError{ 0. };         // Mean absolute fluid minus exact total
+    double maxError{ 0. };
+    double rankCorrelation{ 0. };   // Spearman, fluid against exact
+    double intercept{ 0. };
+    double slope{ 1. };
+    double residualStd{ 0. };       // Of exact against the corrected fluid total
+    double exactSeconds{ 0. };
+    double fluidSeconds{ 0. };
+
+    double corrected(Amount fluidTotal) const { return intercept + slope * fluidTotal; }
+    double speedup() const { return fluidSeconds > 0. ? exactSeconds / fluidSeconds : 0.; }
+};
+
+struct ScreeningResult
+{
+    std::vector<Amount> fluidTotals;        // Corrected, one per candidate
+    std::vector<size_t> confirmed;          // Candidates re-run exactly
+    std::vector<Amount> exactTotals;        // For the confirmed candidates
+    size_t best{ 0 };
+};
+
+/// Screens many strategy configurations with the fluid engine and confirms
+/// the most promising ones with exact simulations. calibrate() measures the
+/// fluid error on a sample of candidates; screen() then runs every candidate
+/// fluidly and re-runs exactly the best `confirm` of them plus any other
+/// whose corrected total is within two residual deviations of the last one
+/// kept.
+class MultiFidelityRunner
+{
+public:
+    MultiFidelityRunner(BatchRunner& runner, Scenario scenario, Ticks iterations, Ticks step)
+        : m_runner(runner)
+        , m_scenario(shareScenario(std::move(scenario)))
+        , m_iterations(iterations)
+        , m_step(step)
+    { }
+
+    FidelityReport calibrate(const std::vector<StrategyFactory>& sample)
+    {
+        const size_t n = sample.size();
+        std::vector<Amount> exact(n);
+        std::vector<Amount> fluid(n);
+        std::vector<double> exactSeconds(n);
+        std::vector<double> fluidSeconds(n);
+        m_runner.run(n, [&](size_t i) {
+            auto start = std::chrono::steady_clock::now();
+            exact[i] = runExact(sample[i]);
+            exactSeconds[i] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            start = std::chrono::steady_clock::now();
+            fluid[i] = runFluid(sample[i]);
+            fluidSeconds[i] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        });
+
+        FidelityReport report;
+        report.samples = n;
+        if (n == 0)
+        {
+            m_fidelity = report;
+            return report;
+        }
+
+        double meanExact{ 0. };
+        double meanFluid{ 0. };
+        for (size_t i{ 0 }; i < n; ++i)
+        {
+            const double error = std::abs(fluid[i] - exact[i]);
+            report.meanError += error / n;
+            report.maxError = std::max(report.maxError, error);
+            report.exactSeconds += exactSeconds[i];
+            report.fluidSeconds += fluidSeconds[i];
+            meanExact += exact[i] / n;
+            meanFluid += fluid[i] / n;
+        }
+
+        double covariance{ 0. };
+        double fluidVariance{ 0. };
+        for (size_t i{ 0 }; i < n; ++i)
+        {
+            covariance += (fluid[i] - meanFluid) * (exact[i] - meanExact);
+            fluidVariance += (fluid[i] - meanFluid) * (fluid[i] - meanFluid);
+        }
+        report.slope = fluidVariance > 0. ? covariance / fluidVariance : 1.;
+        report.intercept = meanExact - report.slope * meanFluid;
+
+        double residuals{ 0. };
+        for (size_t i{ 0 }; i < n; ++i)
+        {
+            const double residual = exact[i] - report.corrected(fluid[i]);
+            residuals += residual * residual;
+        }
+        report.residualStd = std::sqrt(residuals / std::max<double>(static_cast<double>(n) - 2., 1.));
+        report.rankCorrelation = spearman(fluid, exact);
+
+        m_fidelity = report;
+        return report;
+    }
+
+    ScreeningResult screen(const std::vector<StrategyFactory>& candidates, size_t confirm)
+    {
+        ScreeningResult result;
+        result.fluidTotals.resize(candidates.size());
+        m_runner.run(candidates.size(), [&](size_t i) { result.fluidTotals[i] = m_fidelity.corrected(runFluid(candidates[i])); });
+        if (candidates.empty())
+        {
+            return result;
+        }
+
+        std::vector<size_t> order(candidates.size());
+        for (size_t i{ 0 }; i < order.size(); ++i)
+        {
+            order[i] = i;
+        }
+        std::sort(order.begin(), order.end(), [&result](size_t a, size_t b) { return result.fluidTotals[a] > result.fluidTotals[b]; });
+
+        const size_t kept = std::min(std::max<size_t>(confirm, 1), order.size());
+        const Amount cutoff = result.fluidTotals[order[kept - 1]] - 2. * m_fidelity.residualStd;
+        for (size_t i{ 0 }; i < order.size() && (i < kept || result.fluidTotals[order[i]] >= cutoff); ++i)
+        {
+            result.confirmed.push_back(order[i]);
+        }
+
+        result.exactTotals.resize(result.confirmed.size());
+        m_runner.run(result.confirmed.size(), [&](size_t i) { result.exactTotals[i] = runExact(candidates[result.confirmed[i]]); });
+
+        const size_t best = static_cast<size_t>(std::max_element(result.exactTotals.begin(), result.exactTotals.end()) - result.exactTotals.begin());
+        result.best = result.confirmed[best];
+        return result;
+    }
+
+    const FidelityReport& fidelity() const { return m_fidelity; }
+
+private:
+    Amount runExact(const StrategyFactory& factory) const
+    {
+        auto strategy = factory();
+        Simulation sim(strategy.get(), m_scenario);
+        sim.setVerbose(false);
+        sim.advance(m_iterations);
+        return sim.total();
+    }
+
+    Amount runFluid(const StrategyFactory& factory) const
+    {
+        auto strategy = factory();
+        FluidSimulation sim(strategy.get(), m_scenario, m_step);
+        sim.advance(m_iterations);
+        return sim.total();
+    }
+
+    static std::vector<double> ranks(const std::vector<Amount>& values)
+    {
+        std::vector<size_t> order(values.size());
+        for (size_t i{ 0 }; i < order.size(); ++i)
+        {
+            order[i] = i;
+        }
+        std::sort(order.begin(), order.end(), [&values](size_t a, size_t b) { return values[a] < values[b]; });
+
+        // Ties share their average rank
+        std::vector<double> rank(values.size());
+        for (size_t i{ 0 }; i < order.size();)
+        {
+            size_t j = i;
+            while (j + 1 < order.size() && values[order[j + 1]] == values[order[i]])
+            {
+                ++j;
+            }
+            for (size_t k{ i }; k <= j; ++k)
+            {
+                rank[order[k]] = 0.5 * (i + j);
+            }
+            i = j + 1;
+        }
+        return rank;
+    }
+
+    static double spearman(const std::vector<Amount>& a, const std::vector<Amount>& b)
+    {
+        const std::vector<double> ra = ranks(a);
+        const std::vector<double> rb = ranks(b);
+        const double mean = 0.5 * (static_cast<double>(a.size()) - 1.);
+        double covariance{ 0. };
+        double varianceA{ 0. };
+        double varianceB{ 0. };
+        for (size_t i{ 0 }; i < a.size(); ++i)
+        {
+            covariance += (ra[i] - mean) * (rb[i] - mean);
+            varianceA += (ra[i] - mean) * (ra[i] - mean);
+            varianceB += (rb[i] - mean) * (rb[i] - mean);
+        }
+        return varianceA > 0. && varianceB > 0. ? covariance / std::sqrt(varianceA * varianceB) : 0.;
+    }
+
+    BatchRunner& m_runner;
+    const SharedScenario m_scenario;
+    const Ticks m_iterations;
+    const Ticks m_step;
+    FidelityReport m_fidelity;
+};
+
+/// Recorded observations of one chain, ordered by tick. Pool levels are
+/// taken at the start of each tick after regen, taken amounts are what was
+/// filled out of each pool during the tick. Gas and surplus samples are the
+/// per-fill costs and surplus ratios seen on the chain.
+struct ChainObservations
+{
+    std::string chain;
+    std::vector<Ticks> ticks;
+    std::vector<Amount> orderflowBal;
+    std::vector<Amount> outflowBal;
+    std::vector<Amount> orderflowTaken;
+    std::vector<Amount> outflowTaken;
+    std::vector<Amount> gas;
+    std::vector<Amount> surplus;
+};
+
+struct ObservedTrace
+{
+    std::vector<ChainObservations> chains;
+
+    // Reads "tick,chain,orderflowBal,outflowBal,orderflowTaken,outflowTaken,gas,surplus"
+    // lines, a non-numeric first line is taken as a header. Gas and surplus
+    // may be missing, empty or nan where nothing was filled. Fails on any
+    // other line which does not hold six to eight fields of those kinds.
+    bool load(const std::string& path)
+    {
+        std::ifstream in(path);
+        if (!in)
+        {
+            return false;
+        }
+
+        struct Row { Ticks tick; Amount orderflowBal, outflowBal, orderflowTaken, outflowTaken, gas, surplus; };
+        std::vector<std::vector<Row>> rows;
+        std::unordered_map<std::string, size_t> index;
+        chains.clear();
+
+        // Whole field must parse, empty or nan only where optional
+        auto number = [](const std::string& field, bool optional, Amount& value) {
+            value = std::numeric_limits<Amount>::quiet_NaN();
+            if (field.empty())
+            {
+                return optional;
+            }
+            char* end{ nullptr };
+            value = std::strtod(field.c_str(), &end);
+            return end == field.c_str() + field.size() && (optional || !std::isnan(value));
+        };
+
+        std::string line;
+        for (bool first{ true }; std::getline(in, line); first = false)
+        {
+            if (!line.empty() && line.back() == '\r')
+            {
+                line.pop_back();
+            }
+            if (line.empty() || (first && !std::isdigit(static_cast<unsigned char>(line[0]))))
+            {
+                continue;
+            }
+
+            std::vector<std::string> fields;
+            std::istringstream split(line);
+            for (std::string field; std::getline(split, field, ',');)
+            {
+                fields.push_back(field);
+            }
+            if (fields.size() < 6 || fields.size() > 8 || fields[1].empty() || !std::isdigit(static_cast<unsigned char>(fields[0][0])))
+            {
+                return false;
+            }
+            fields.resize(8);
+
+            Row row{};
+            char* end{ nullptr };
+            row.tick = std::strtoull(fields[0].c_str(), &end, 10);
+            if (end != fields[0].c_str() + fields[0].size()
+                || !number(fields[2], false, row.orderflowBal) || !number(fields[3], false, row.outflowBal)
+                || !number(fields[4], false, row.orderflowTaken) || !number(fields[5], false, row.outflowTaken)
+                || !number(fields[6], true, row.gas) || !number(fields[7], true, row.surplus))
+            {
+                return false;
+            }
+
+            auto it = index.emplace(fields[1], chains.size()).first;
+            if (it->second == chains.size())
+            {
+                chains.emplace_back();
+                chains.back().chain = fields[1];
+                rows.emplace_back();
+            }
+            rows[it->second].push_back(row);
+        }
+
+        for (size_t c{ 0 }; c < chains.size(); ++c)
+        {
+            std::sort(rows[c].begin(), rows[c].end(), [](const Row& a, const Row& b) { return a.tick < b.tick; });
+            ChainObservations& chain = chains[c];
+            for (const auto& row : rows[c])
+            {
+                chain.ticks.push_back(row.tick);
+                chain.orderflowBal.push_back(row.orderflowBal);
+                chain.outflowBal.push_back(row.outflowBal);
+                chain.orderflowTaken.push_back(row.orderflowTaken);
+                chain.outflowTaken.push_back(row.outflowTaken);
+                if (!std::isnan(row.gas))
+                {
+                    chain.gas.push_back(row.gas);
+                }
+                if (!std::isnan(row.surplus))
+                {
+                    chain.surplus.push_back(row.surplus);
+                }
+            }
+        }
+        return true;
+    }
+};
+
+struct PoolFit
+{
+    Amount regenPerTick{ 0. };
+    Amount noise{ 0. };         // Standard deviation of the per-tick regen
+    Amount maxBal{ 0. };
+    double logLikelihood{ 0. };
+    size_t transitions{ 0 };
+    size_t capped{ 0 };         // Transitions that ended at the pool maximum
+};
+
+struct ChainFit
+{
+    std::string chain;
+    PoolFit orderflow;
+    PoolFit outflow;
+    Amount gasMean{ 0. };
+    Amount gasStddev{ 0. };
+    Amount surplusMean{ 0. };
+    Amount surplusStddev{ 0. };
+    Amount initialOrderflowBal{ 0. };
+    Amount initialOutflowBal{ 0. };
+};
+
+/// Fits ChainParams to recorded pool levels by maximum likelihood, one
+/// chain per job on the batch runner. Each pool follows
+///   level(t+1) = min(level(t) - taken(t) + regen + noise, max)
+/// with Gaussian noise. The maximum is the highest level observed (its MLE)
+/// and transitions ending at it are treated as censored, giving a Tobit
+/// likelihood maximized over regen and noise by alternating golden-section
+/// searches. Gas and surplus are fitted as normals. Transitions across gaps
+/// in the recorded ticks are skipped.
+class Calibrator
+{
+public:
+    explicit Calibrator(BatchRunner& runner)
+        : m_runner(runner)
+    { }
+
+    std::vector<ChainFit> fit(const ObservedTrace& trace)
+    {
+        std::vector<ChainFit> fits(trace.chains.size());
+        m_runner.run(fits.size(), [&](size_t c) {
+            const ChainObservations& chain = trace.chains[c];
+            ChainFit& fit = fits[c];
+            fit.chain = chain.chain;
+            fit.orderflow = fitPool(chain.ticks, chain.orderflowBal, chain.orderflowTaken);
+            fit.outflow = fitPool(chain.ticks, chain.outflowBal, chain.outflowTaken);
+            std::tie(fit.gasMean, fit.gasStddev) = normal(chain.gas);
+            std::tie(fit.surplusMean, fit.surplusStddev) = normal(chain.surplus);
+            fit.initialOrderflowBal = chain.orderflowBal.empty() ? 0. : chain.orderflowBal.front();
+            fit.initialOutflowBal = chain.outflowBal.empty() ? 0. : chain.outflowBal.front();
+        });
+        return fits;
+    }
+
+    // Scenario for the fitted chains. Lock times and starting strategy
+    // balances, which the trace does not record, come from the matching
+    // chain of base, or default to 4 ticks and 0.
+    static Scenario toScenario(const std::vector<ChainFit>& fits, const Scenario& base = {})
+    {
+        Scenario scenario;
+        for (const auto& fit : fits)
+        {
+            auto it = std::find_if(base.begin(), base.end(), [&fit](const ChainSpec& spec) { return spec.name == fit.chain; });
+            const bool known = it != base.end();
+            scenario.push_back(ChainSpec{ fit.chain,
+                ChainParams{
+                    fit.orderflow.regenPerTick,
+                    fit.outflow.regenPerTick,
+                    fit.gasMean,
+                    fit.surplusMean > 0. ? fit.surplusMean : 1.,
+                    known ? it->params.bridgingTime : 4,
+                    known ? it->params.inventoryLockTime : 4
+                },
+                fit.initialOrderflowBal,
+                fit.initialOutflowBal,
+                known ? it->startingStrategyBal : 0.,
+                fit.orderflow.maxBal,
+                fit.outflow.maxBal });
+        }
+        return scenario;
+    }
+
+private:
+    struct Transition
+    {
+        Amount base;    // level(t) - taken(t)
+        Amount next;
+        bool capped;
+    };
+
+    static std::pair<Amount, Amount> normal(const std::vector<Amount>& samples)
+    {
+        if (samples.empty())
+        {
+            return { 0., 0. };
+        }
+
+        Amount mean{ 0. };
+        for (Amount v : samples)
+        {
+            mean += v;
+        }
+        mean /= samples.size();
+
+        Amount variance{ 0. };
+        for (Amount v : samples)
+        {
+            variance += (v - mean) * (v - mean);
+        }
+        return { mean, std::sqrt(variance / samples.size()) };
+    }
+
+    static double logLikelihood(const std::vector<Transition>& transitions, Amount maxBal, Amount regen, Amount noise)
+    {
+        constexpr double logRoot2Pi = 0.91893853320467274178;
+        double total{ 0. };
+        for (const auto& t : transitions)
+        {
+            const double z = ((t.capped ? maxBal : t.next) - t.base - regen) / noise;
+            total += t.capped
+                ? std::log(std::max(0.5 * std::erfc(z / std::sqrt(2.)), 1e-300))
+                : -0.5 * z * z - std::log(noise) - logRoot2Pi;
+        }
+        return total;
+    }
+
+    template <typename F>
+    static double goldenMax(F f, double low, double high)
+    {
+        const double ratio = (std::sqrt(5.) - 1.) / 2.;
+        double a = low;
+        double b = high;
+        double c = b - ratio * (b - a);
+        double d = a + ratio * (b - a);
+        double fc = f(c);
+        double fd = f(d);
+        for (int i{ 0 }; i < 60; ++i)
+        {
+            if (fc > fd)
+            {
+                b = d; d = c; fd = fc;
+                c = b - ratio * (b - a); fc = f(c);
+            }
+            else
+            {
+                a = c; c = d; fc = fd;
+                d = a + ratio * (b - a); fd = f(d);
+            }
+        }
+        return (a + b) / 2.;
+    }
+
+    static PoolFit fitPool(const std::vector<Ticks>& ticks, const std::vector<Amount>& level, const std::vector<Amount>& taken)
+    {
+        PoolFit fit;
+        for (Amount v : level)
+        {
+            fit.maxBal = std::isnan(v) ? fit.maxBal : std::max(fit.maxBal, v);
+        }
+
+        std::vector<Transition> transitions;
+        double meanStep{ 0. };
+        for (size_t k{ 0 }; k + 1 < ticks.size(); ++k)
+        {
+            const Amount base = level[k] - (std::isnan(taken[k]) ? 0. : taken[k]);
+            if (ticks[k + 1] != ticks[k] + 1 || std::isnan(base) || std::isnan(level[k + 1]))
+            {
+                continue;
+            }
+
+            const bool capped = level[k + 1] >= fit.maxBal * (1. - 1e-9);
+            transitions.push_back(Transition{ base, level[k + 1], capped });
+            meanStep += level[k + 1] - base;
+            fit.capped += capped;
+        }
+
+        fit.transitions = transitions.size();
+        if (transitions.empty())
+        {
+            return fit;
+        }
+        meanStep /= transitions.size();
+
+        // Capped transitions only bound the regen from below, so search up
+        // to well past the largest step seen
+        double spread{ 0. };
+        double largest = meanStep;
+        for (const auto& t : transitions)
+        {
+            spread += (t.next - t.base - meanStep) * (t.next - t.base - meanStep);
+            largest = std::max(largest, t.next - t.base);
+        }
+        spread = std::sqrt(spread / transitions.size());
+
+        const double span = std::max({ spread, std::abs(largest), 1e-9 });
+        double regen = meanStep;
+        double noise = std::max(spread, 1e-9);
+        for (int round{ 0 }; round < 8; ++round)
+        {
+            regen = goldenMax([&](double r) { return logLikelihood(transitions, fit.maxBal, r, noise); },
+                meanStep - 4. * span, largest + 4. * span);
+            noise = std::exp(goldenMax([&](double logNoise) { return logLikelihood(transitions, fit.maxBal, regen, std::exp(logNoise)); },
+                std::log(span) - 20., std::log(span) + 5.));
+        }
+
+        fit.regenPerTick = regen;
+        fit.noise = noise;
+        fit.logLikelihood = logLikelihood(transitions, fit.maxBal, regen, noise);
+        return fit;
+    }
+
+    BatchRunner& m_runner;
+};
+
+/// Small fully connected network evaluated in float32. Weights are stored
+/// column-major with each column padded to a multiple of 8 floats, so a
+/// layer is computed as a sum of input-scaled columns running over whole
+/// AVX (or SSE) vectors of outputs, accumulated in registers a block at a
+/// time with no horizontal sums. Activations live in buffers allocated once
+/// at load so evaluation does not allocate.
+///
+/// Weight files are whitespace separated: the layer count, then for each
+/// layer its output and input sizes followed by the weights row by row and
+/// the biases. Hidden layers use ReLU, the output layer is linear.
+class MlpPolicy
+{
+public:
+    bool load(const std::string& path)
+    {
+        std::ifstream in(path);
+        size_t layers{ 0 };
+        if (!(in >> layers) || layers == 0)
+        {
+            return false;
+        }
+
+        m_layers.clear();
+        for (size_t l{ 0 }; l < layers; ++l)
+        {
+            Layer layer;
+            if (!(in >> layer.outputs >> layer.inputs) || (l > 0 && layer.inputs != m_layers.back().outputs))
+            {
+                return false;
+            }
+
+            layer.stride = padded(layer.outputs);
+            layer.weights.assign(layer.inputs * layer.stride, 0.f);
+            layer.bias.assign(layer.stride, 0.f);
+            for (size_t r{ 0 }; r < layer.outputs; ++r)
+            {
+                for (size_t c{ 0 }; c < layer.inputs; ++c)
+                {
+                    in >> layer.weights[c * layer.stride + r];
+                }
+            }
+            for (size_t r{ 0 }; r < layer.outputs; ++r)
+            {
+                in >> layer.bias[r];
+            }
+            if (!in)
+            {
+                return false;
+            }
+            m_layers.push_back(std::move(layer));
+        }
+
+        size_t widest = padded(inputs());
+        for (const auto& layer : m_layers)
+        {
+            widest = std::max(widest, layer.stride);
+        }
+        m_buffers[0].assign(widest, 0.f);
+        m_buffers[1].assign(widest, 0.f);
+        return true;
+    }
+
+    size_t inputs() const { return m_layers.empty() ? 0 : m_layers.front().inputs; }
+    size_t outputs() const { return m_layers.empty() ? 0 : m_layers.back().outputs; }
+
+    // outputs() values for one input vector of inputs() values
+    void evaluate(const float* input, float* output)
+    {
+        const float* x = input;
+        size_t current{ 0 };
+        for (size_t l{ 0 }; l < m_layers.size(); ++l)
+        {
+            float* y = m_buffers[current].data();
+            dense(m_layers[l], x, y, l + 1 < m_layers.size());
+            x = y;
+            current = 1 - current;
+        }
+        std::copy(x, x + outputs(), output);
+    }
+
+    // Evaluates batch input vectors laid out back to back, e.g. one per
+    // simulation, keeping the weights hot in cache across them
+    void evaluateBatch(const float* inputs, size_t batch, float* outputs)
+    {
+        for (size_t b{ 0 }; b < batch; ++b)
+        {
+            evaluate(inputs + b * this->inputs(), outputs + b * this->outputs());
+        }
+    }
+
+private:
+    struct Layer
+    {
+        size_t inputs{ 0 };
+        size_t outputs{ 0 };
+        size_t stride{ 0 };             // Padded outputs, distance between columns
+        std::vector<float> weights;     // Column-major
+        std::vector<float> bias;        // Padded with zeros
+    };
+
+#if defined(__AVX__)
+    using Vec = __m256;
+    static constexpr size_t lanes = 8;
+    static Vec load(const float* p) { return _mm256_loadu_ps(p); }
+    static void store(float* p, Vec v) { _mm256_storeu_ps(p, v); }
+    static Vec broadcast(float f) { return _mm256_set1_ps(f); }
+    static Vec relu(Vec v) { return _mm256_max_ps(v, _mm256_setzero_ps()); }
+#if defined(__FMA__)
+    static Vec fma(Vec a, Vec b, Vec c) { return _mm256_fmadd_ps(a, b, c); }
+#else
+    static Vec fma(Vec a, Vec b, Vec c) { return _mm256_add_ps(_mm256_mul_ps(a, b), c); }
+#endif
+#elif defined(__SSE2__) || defined(_M_X64)
+    using Vec = __m128;
+    static constexpr size_t lanes = 4;
+    static Vec load(const float* p) { return _mm_loadu_ps(p); }
+    static void store(float* p, Vec v) { _mm_storeu_ps(p, v); }
+    static Vec broadcast(float f) { return _mm_set1_ps(f); }
+    static Vec relu(Vec v) { return _mm_max_ps(v, _mm_setzero_ps()); }
+    static Vec fma(Vec a, Vec b, Vec c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+#else
+    using Vec = float;
+    static constexpr size_t lanes = 1;
+    static Vec load(const float* p) { return *p; }
+    static void store(float* p, Vec v) { *p = v; }
+    static Vec broadcast(float f) { return f; }
+    static Vec relu(Vec v) { return v < 0.f ? 0.f : v; }
+    static Vec fma(Vec a, Vec b, Vec c) { return a * b + c; }
+#endif
+
+    static size_t padded(size_t n) { return (n + 7) / 8 * 8; }
+
+    // y = W x + b, four vectors of outputs at a time kept in registers
+    // across the whole input loop
+    static void dense(const Layer& layer, const float* x, float* y, bool applyRelu)
+    {
+        constexpr size_t block = 4 * lanes;
+        size_t r{ 0 };
+        for (; r + block <= layer.stride; r += block)
+        {
+            Vec acc0 = load(&layer.bias[r]);
+            Vec acc1 = load(&layer.bias[r + lanes]);
+            Vec acc2 = load(&layer.bias[r + 2 * lanes]);
+            Vec acc3 = load(&layer.bias[r + 3 * lanes]);
+            const float* column = layer.weights.data() + r;
+            for (size_t c{ 0 }; c < layer.inputs; ++c, column += layer.stride)
+            {
+                const Vec xc = broadcast(x[c]);
+                acc0 = fma(xc, load(column), acc0);
+                acc1 = fma(xc, load(column + lanes), acc1);
+                acc2 = fma(xc, load(column + 2 * lanes), acc2);
+                acc3 = fma(xc, load(column + 3 * lanes), acc3);
+            }
+            store(y + r, applyRelu ? relu(acc0) : acc0);
+            store(y + r + lanes, applyRelu ? relu(acc1) : acc1);
+            store(y + r + 2 * lanes, applyRelu ? relu(acc2) : acc2);
+            store(y + r + 3 * lanes, applyRelu ? relu(acc3) : acc3);
+        }
+
+        for (; r < layer.stride; r += lanes)
+        {
+            Vec acc = load(&layer.bias[r]);
+            const float* column = layer.weights.data() + r;
+            for (size_t c{ 0 }; c < layer.inputs; ++c, column += layer.stride)
+            {
+                acc = fma(broadcast(x[c]), load(column), acc);
+            }
+            store(y + r, applyRelu ? relu(acc) : acc);
+        }
+    }
+
+    std::vector<Layer> m_layers;
+    std::vector<float> m_buffers[2];
+};
+
+/// Strategy implementation
+
+class Strategy : public IStrategy
+{
+public:
+    virtual void onTickRecalc(const Chains& chains, Actions& actions) override
+    {
+        const Chain* pChainA = getChain(chains, "A");
+        const Chain* pChainB = getChain(chains, "B");
+        const Chain* pChainC = getChain(chains, "C");
+
+        // TODO return actions object with steps in this tick
+        // e.g.1
+        // To bridge 2 from A to B we would perform:
+        
+        if (   pChainA->balance > 2
+            && pChainB->currentOutflowBal > 2)
+        {
+            actions.push_back(Action{ Action::type::bridge, "A", "B", 2 });
+        }
+
+        // e.g.2
+        // To fill an order of 5 on chain B and being funded on A we would perform:
+        if (   pChainB->balance > 5 
+            && pChainB->currentOrderflowBal > 5 )
+        {
+            actions.push_back(Action{ Action::type::execute, "B", "A", 5 });
+        }
+    }
+
+    const Chain* getChain(const Chains& chains, const std::string& name)
+    {
+        auto it = std::find_if(chains.begin(), chains.end(),
+            [&name](const Chain& chain) {
+                return chain.chainName() == name;
+            });
+
+        if (it != chains.end()) {
+            return &(*it);
+        }
+        return nullptr;
+    }
+};
+
+/// Strategy driven by an MlpPolicy. The feature vector holds, for every
+/// chain in order, its balance, locked amount, order flow and bridging pool
+/// levels and the two pools' fill ratios. The policy outputs two amounts for
+/// each ordered pair of chains (i, j != i), enumerated by i then j: a bridge
+/// from i to j and an execute from i to j. Amounts above minAmount which the
+/// source balance covers become actions.
+class PolicyStrategy : public IStrategy
+{
+public:
+    static constexpr size_t featuresPerChain = 6;
+
+    explicit PolicyStrategy(MlpPolicy policy, Amount minAmount = 0.01)
+        : m_policy(std::move(policy))
+        , m_minAmount(minAmount)
+    { }
+
+    static size_t inputsFor(size_t chainCount) { return chainCount * featuresPerChain; }
+    static size_t outputsFor(size_t chainCount) { return 2 * chainCount * (chainCount - 1); }
+
+    static void features(const Chains& chains, float* out)
+    {
+        for (const auto& chain : chains)
+        {
+            Amount locked{ 0. };
+            for (const auto& [amount, ticks] : chain.lockedBalances)
+            {
+                locked += amount;
+            }
+            *out++ = static_cast<float>(chain.balance);
+            *out++ = static_cast<float>(locked);
+            *out++ = static_cast<float>(chain.currentOrderflowBal);
+            *out++ = static_cast<float>(chain.currentOutflowBal);
+            *out++ = static_cast<float>(chain.maxOrderflowBal > 0. ? chain.currentOrderflowBal / chain.maxOrderflowBal : 0.);
+            *out++ = static_cast<float>(chain.maxOutflowBal > 0. ? chain.currentOutflowBal / chain.maxOutflowBal : 0.);
+        }
+    }
+
+    virtual void onTickRecalc(const Chains& chains, Actions& actions) override
+    {
+        if (m_policy.inputs() != inputsFor(chains.size()) || m_policy.outputs() != outputsFor(chains.size()))
+        {
+            return;
+        }
+
+        m_features.resize(m_policy.inputs());
+        m_outputs.resize(m_policy.outputs());
+        features(chains, m_features.data());
+        m_policy.evaluate(m_features.data(), m_outputs.data());
+
+        size_t k{ 0 };
+        for (size_t i{ 0 }; i < chains.size(); ++i)
+        {
+            Amount available = chains[i].balance;
+            for (size_t j{ 0 }; j < chains.size(); ++j)
+            {
+                if (i == j)
+                {
+                    continue;
+                }
+
+                for (auto type : { Action::type::bridge, Action::type::execute })
+                {
+                    const Amount amount = m_outputs[k++];
+                    if (amount > m_minAmount && amount <= available)
+                    {
+                        available -= amount;
+                        actions.push_back(Action{ type, chains[i].chainName(), chains[j].chainName(), amount });
+                    }
+                }
+            }
+        }
+    }
+
+private:
+    MlpPolicy m_policy;
+    const Amount m_minAmount;
+    std::vector<float> m_features;
+    std::vector<float> m_outputs;
+};
+
+/// Meta-strategy delegating to whichever candidate strategy currently does
+/// best. Each candidate drives a shadow simulation advanced in step with the
+/// live one, a tick per live tick, and is scored on the surplus its shadow
+/// realized over a rolling window of the last window ticks. The live
+/// actions come from the best score. Every candidate's live instance is fed
+/// the live chains each tick, its actions dropped while inactive, so
+/// stateful candidates are current when switched in. Shadows regenerate
+/// from the chain params only, flow traces, bots and other assets are not
+/// replayed in them, so they are re-anchored to a copy of the live chains
+/// every window ticks, keeping their strategies. Candidates run in parallel
+/// on the batch runner.
+class ShadowMetaStrategy : public IStrategy
+{
+public:
+    ShadowMetaStrategy(std::vector<StrategyFactory> candidates, BatchRunner& runner, Ticks window = 100)
+        : m_runner(runner)
+        , m_window(std::max<Ticks>(window, 1))
+    {
+        for (const auto& factory : candidates)
+        {
+            m_live.push_back(factory());
+            m_shadows.push_back(Shadow{ factory(), nullptr });
+        }
+        m_actions.resize(m_live.size());
+        m_history.assign(m_window * m_live.size(), 0.);
+        m_scores.assign(m_live.size(), 0.);
+    }
+
+    size_t active() const { return m_active; }
+    // Surplus of each candidate's shadow over the last window ticks
+    const std::vector<Amount>& scores() const { return m_scores; }
+    uint64_t switches() const { return m_switches; }
+
+    virtual void onTickRecalc(const Chains& chains, Actions& actions) override
+    {
+        if (m_live.empty())
+        {
+            return;
+        }
+
+        const bool anchor = m_tick % m_window == 0;
+        Amount* surplus = &m_history[(m_tick % m_window) * m_live.size()];
+        m_runner.run(m_live.size(), [&](size_t i) {
+            m_actions[i].clear();
+            m_live[i]->onTickRecalc(chains, m_actions[i]);
+
+            Shadow& shadow = m_shadows[i];
+            if (anchor)
+            {
+                shadow.sim = std::make_unique<Simulation>(shadow.strategy.get(), chains);
+                shadow.sim->setVerbose(false);
+            }
+            const Amount before = shadow.sim->total();
+            shadow.sim->advance(1);
+            m_scores[i] -= surplus[i];
+            surplus[i] = shadow.sim->total() - before;
+            m_scores[i] += surplus[i];
+        });
+
+        // The running sums drift with rounding, so they are summed afresh
+        // each time the ring wraps
+        if (++m_tick % m_window == 0)
+        {
+            resum();
+        }
+
+        size_t best = m_active;
+        for (size_t i{ 0 }; i < m_live.size(); ++i)
+        {
+            if (m_scores[i] > m_scores[best])
+            {
+                best = i;
+            }
+        }
+        m_switches += best != m_active;
+        m_active = best;
+
+        actions.insert(actions.end(), m_actions[m_active].begin(), m_actions[m_active].end());
+    }
+
+private:
+    struct Shadow
+    {
+        std::unique_ptr<IStrategy> strategy;
+        std::unique_ptr<Simulation> sim;
+    };
+
+    void resum()
+    {
+        std::fill(m_scores.begin(), m_scores.end(), 0.);
+        for (Ticks t{ 0 }; t < m_window; ++t)
+        {
+            for (size_t i{ 0 }; i < m_live.size(); ++i)
+            {
+                m_scores[i] += m_history[t * m_live.size() + i];
+            }
+        }
+    }
+
+    std::vector<std::unique_ptr<IStrategy>> m_live;
+    std::vector<Shadow> m_shadows;
+    BatchRunner& m_runner;
+    const Ticks m_window;
+
+    std::vector<Actions> m_actions;
+    std::vector<Amount> m_history;      // Per-tick shadow surplus, [tick % window * candidates + candidate]
+    std::vector<Amount> m_scores;
+    Ticks m_tick{ 0 };
+    size_t m_active{ 0 };
+    uint64_t m_switches{ 0 };
 };
 
 int main()